@@ -0,0 +1,26 @@
+//Six axis aligned 90 degree cones through the dense volume for the compute passes (bounce.comp, probes.comp),
+//a cone each covers the sphere. Texture coordinates and t are in units of the volume's side
+uniform sampler3D tex;
+uniform bool anisotropic;
+uniform sampler3D anisoTex[6];
+
+const vec3 coneDirections[6] = { vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1) };
+const float MAX_ALPHA = 1.0;
+const float stepValue = 0.5;
+
+vec4 sampleVolume(int face, vec3 texCoord, float mip)
+{
+	if (!anisotropic || mip <= 0.0)
+		return textureLod(tex, texCoord, mip);
+	//an axis aligned cone only looks through the directional mips of its own face, indexed by constants
+	float anisoMip = max(mip - 1.0, 0.0);
+	vec4 result = face == 0 ? textureLod(anisoTex[0], texCoord, anisoMip)
+		: face == 1 ? textureLod(anisoTex[1], texCoord, anisoMip)
+		: face == 2 ? textureLod(anisoTex[2], texCoord, anisoMip)
+		: face == 3 ? textureLod(anisoTex[3], texCoord, anisoMip)
+		: face == 4 ? textureLod(anisoTex[4], texCoord, anisoMip)
+		: textureLod(anisoTex[5], texCoord, anisoMip);
+	if (mip < 1.0)
+		result = mix(textureLod(tex, texCoord, 0.0), result, mip);
+	return result;
+}
@@ -1,10 +1,66 @@
 #version 450 core
-uniform sampler3D tex;
+//DirVXGI builds one program per PASS (below), with OCTREE_STORAGE defined for octree storage, so that none
+//reads more than the 16 samplers a fragment stage is guaranteed
 out vec4 fragColor;
 
-uniform vec3 minPos;
-uniform vec3 maxPos;
-uniform int Step;
+#define FRAME_BLOCK
+#define LIGHT_BLOCK
+#define VOLUME_BLOCK
+#include "uniformBlocks.glsl"
+
+#ifdef OCTREE_STORAGE
+//octree storage: node pool and brick pool written by svo.comp
+uniform sampler3D brickPool;
+uniform int brickPoolSize;
+uniform int octreeLevels;
+layout(std430, binding = 4) readonly buffer NodePool {
+	uint nodes[];
+};
+#else
+//dense and clipmap storage
+uniform sampler3D tex;
+
+//anisotropic mips: +X, -X, +Y, -Y, +Z, -Z, level 0 of each matches mip 1 of tex
+uniform bool anisotropic;
+uniform sampler3D anisoTex[6];
+
+#include "emptySpace.glsl"
+#endif
+
+//clipmap storage: levels stacked along z in tex, level i is 2^i times the minPos/maxPos box,
+//addressed toroidally by world position so texels stay put while a level scrolls
+#define MAX_CLIPMAP_LEVELS 8
+uniform int clipmapLevels;
+uniform vec3 clipMin[MAX_CLIPMAP_LEVELS];
+
+//forward: everything per rasterized fragment. Deferred: PASS_DIFFUSE traces the diffuse cones for one G-buffer texel
+//per scale x scale block, PASS_COMPOSITE upsamples them and adds the specular cone and direct light at full resolution
+#define PASS_FORWARD 0
+#define PASS_DIFFUSE 1
+#define PASS_COMPOSITE 2
+uniform int scale;
+#if PASS != PASS_FORWARD
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+#endif
+#if PASS == PASS_COMPOSITE
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D indirect;
+#endif
+//temporal accumulation: PASS_DIFFUSE traces conesPerFrame of the six cones (0: all), the subset and the rotation
+//about the normal change with frameIndex and jitter, see temporal.frag
+uniform int conesPerFrame;
+uniform int frameIndex;
+uniform float jitter;
+
+//irradiance probes from probes.comp replace the diffuse cones: probes^3 cell centred in the minPos/maxPos box,
+//z slabs 0-3 hold L1 spherical harmonics of radiance and occlusion, 4-5 the free distance along the +/- axes
+uniform bool useProbes;
+#if PASS != PASS_DIFFUSE
+uniform sampler3D probeTex;
+#endif
+uniform int probes;
 
 in VS_OUT{
 	vec3 fragPos;
@@ -19,19 +75,14 @@ struct Material {
 	float roughness;
 	float shininess;
 };
+#if PASS == PASS_FORWARD
 uniform Material material;
+#endif
 
-struct DirLight {
-	vec3 direction;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-uniform DirLight dirlight;
-
-uniform vec3 viewPos;
+#if PASS != PASS_DIFFUSE
 uniform sampler2D gPositionDepth;
+#include "shadowCone.glsl"
+#endif
 
 vec3 coneDirections[6] = {vec3(0, 0, 1),
                           vec3(0, 0.866025,0.5),
@@ -46,43 +97,225 @@ float weight[6] =  {1.0/4.0,
 					3.0/20.0,
 					3.0/20.0};
 const float PI = 3.14159265359;
-const float tan30 = tan(PI/6.0);
 const float MAX_ALPHA = 1.0;
-const float MAX_LENGTH = length(maxPos-minPos);
-const float lambda =0.1;
-const float stepValue=0.1;
+//runtime cone parameters, see ConeSettings in VXGI.h
+uniform float lambda;
+uniform float stepValue;
+uniform float maxDistance;
+uniform float diffuseTan;
+uniform int diffuseConeCount;
 float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir);
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewPos, vec3 fragPos);
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewPos, vec3 fragPos, vec3 albedo, vec3 specularColor, float shininess, vec4 fragPosLightSpace);
 vec3 posTransToNdc(vec3 pos);
-vec4 coneTracing(vec3 direction, vec3 N, float tanValue);
+vec3 diffuseCones(vec3 fragPos, vec3 N);
+vec4 jitteredCones(vec3 fragPos, vec3 N, ivec2 pixel);
+vec3 probeIrradiance(vec3 fragPos, vec3 N);
+vec3 upsampleIndirect(ivec2 p, vec3 fragPos, vec3 N);
+vec4 coneTracing(vec3 fragPos, vec3 direction, vec3 N, float tanValue);
+vec4 textureOctree(vec3 p, float mip);
+vec4 textureClipmap(vec3 pos, float lod, vec3 direction);
+vec4 textureVolume(vec3 texCoord, float mip, vec3 direction);
 
 void main()
 {
+#if PASS == PASS_DIFFUSE
+	//the full resolution texel at the centre of this one's block
+	ivec2 p = min(ivec2(gl_FragCoord.xy) * scale + scale / 2, textureSize(gPosition, 0) - 1);
+	vec4 position = texelFetch(gPosition, p, 0);
+	vec3 N = texelFetch(gNormal, p, 0).xyz;
+	//a = 0 where the G-buffer is empty; the jittered cones keep their occlusion apart in a - 1 for temporal.frag
+	if (position.a == 0.0)
+		fragColor = vec4(0.0);
+	else if (conesPerFrame > 0)
+	{
+		vec4 cones = jitteredCones(position.xyz, N, ivec2(gl_FragCoord.xy));
+		fragColor = vec4(cones.rgb, 1.0 + cones.a);
+	}
+	else
+		fragColor = vec4(diffuseCones(position.xyz, N), 1.0);
+#else
+	vec3 fragPos, N, albedo, specularColor;
+	float roughness, shininess;
+	vec4 fragPosLightSpace;
+	vec3 ambient;
+#if PASS == PASS_COMPOSITE
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	vec4 position = texelFetch(gPosition, p, 0);
+	if (position.a == 0.0)
+		discard;
+	vec4 normal = texelFetch(gNormal, p, 0);
+	vec4 specular = texelFetch(gSpecular, p, 0);
+	fragPos = position.xyz;
+	N = normal.xyz;
+	roughness = normal.w;
+	albedo = texelFetch(gAlbedo, p, 0).rgb;
+	specularColor = specular.rgb;
+	shininess = specular.a;
+	fragPosLightSpace = lightSpaceMatrix * vec4(fragPos, 1.0);
+	ambient = useProbes ? probeIrradiance(fragPos, N) : upsampleIndirect(p, fragPos, N);
+#else
+	fragPos = fs_in.fragPos;
+	N = fs_in.normal;
+	roughness = material.roughness;
+	albedo = texture(material.diffuse, fs_in.texCoord).rgb;
+	specularColor = texture(material.specular, fs_in.texCoord).rgb;
+	shininess = material.shininess;
+	fragPosLightSpace = fs_in.fragPosLightSpace;
+	ambient = useProbes ? probeIrradiance(fragPos, N) : diffuseCones(fragPos, N);
+#endif
+
 	//ambient
-	vec3 normal = normalize(fs_in.normal);
+	vec3 viewDir=fragPos-viewPos;
+	vec3 reflectDir = reflect(viewDir,N);
+	ambient +=coneTracing(fragPos,reflectDir,N, tan(sin(roughness*PI/2.0)*PI/2.0)).xyz;
+
+	ambient*=albedo;
+
+	//direct
+	vec3 direct = calcDirLight(dirlight, N, viewPos, fragPos, albedo, specularColor, shininess, fragPosLightSpace);
+	vec3 result = ambient+ direct;
+	fragColor = vec4(result.xyz,1.0);
+#endif
+}
+
+vec3 diffuseCones(vec3 fragPos, vec3 N)
+{
+	vec3 normal = normalize(N);
 	vec3 tangent = normal.z > 0.001 ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
 	vec3 bitangent = cross(normal, tangent);
 	tangent = cross(bitangent, normal);
 	mat3 TBN = mat3(tangent, bitangent, normal);
 
+	//the leading diffuseConeCount cones, their weights renormalized
 	vec4 ambient = vec4(0.0);
-	for(int i=0;i!=6;i++)
+	float total = 0.0;
+	for(int i=0;i!=diffuseConeCount;i++)
 	{
-		ambient+=coneTracing(normalize(TBN * coneDirections[i]),fs_in.normal, tan30)*weight[i];
+		ambient+=coneTracing(fragPos,normalize(TBN * coneDirections[i]),N, diffuseTan)*weight[i];
+		total+=weight[i];
 	}
-	ambient.xyz*=(1.0-ambient.w);
+	ambient/=total;
+	return ambient.xyz*(1.0-ambient.w);
+}
 
-	vec3 viewDir=fs_in.fragPos-viewPos;
-	vec3 reflectDir = reflect(viewDir,fs_in.normal);
-	ambient.xyz +=coneTracing(reflectDir,fs_in.normal, tan(sin(material.roughness*PI/2.0)*PI/2.0)).xyz;
+//a share of the six cones, rotated about the normal by a per frame and per pixel angle: weighted colour and
+//weighted occlusion, scaled by 6 / conesPerFrame. temporal.frag averages both over frames and only then applies
+//the occlusion as diffuseCones does, a product of per frame shares would not average to the six cone result
+vec4 jitteredCones(vec3 fragPos, vec3 N, ivec2 pixel)
+{
+	vec3 normal = normalize(N);
+	vec3 tangent = normal.z > 0.001 ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
+	vec3 bitangent = cross(normal, tangent);
+	tangent = cross(bitangent, normal);
+	mat3 TBN = mat3(tangent, bitangent, normal);
 
-	ambient.xyz*=texture(material.diffuse, fs_in.texCoord).xyz;
+	//interleaved gradient noise, so neighbouring texels trace different cones
+	float noise = fract(52.9829189 * fract(dot(vec2(pixel), vec2(0.06711056, 0.00583715))));
+	float angle = 2.0 * PI * fract(noise + jitter);
+	mat3 rotation = mat3(cos(angle), sin(angle), 0.0, -sin(angle), cos(angle), 0.0, 0.0, 0.0, 1.0);
+	int first = int(noise * 6.0) + frameIndex * conesPerFrame;
 
-	//direct
-	vec3 direct = calcDirLight(dirlight, fs_in.normal, viewPos, fs_in.fragPos);
-	vec3 result = ambient.xyz+ direct;
-	fragColor = vec4(result.xyz,1.0);
+	vec4 ambient = vec4(0.0);
+	for (int k = 0; k != conesPerFrame; k++)
+	{
+		int i = (first + k) % 6;
+		ambient += coneTracing(fragPos, normalize(TBN * rotation * coneDirections[i]), N, diffuseTan) * weight[i];
+	}
+	return ambient * 6.0 / float(conesPerFrame);
+}
+
+#if PASS != PASS_DIFFUSE
+//the eight probes around fragPos, trilinear weights cut down for probes behind the surface and for probes whose
+//cone towards fragPos was stopped before reaching it; irradiance / PI times the cosine weighted unoccluded share,
+//like the diffuse cones
+vec3 probeIrradiance(vec3 fragPos, vec3 N)
+{
+	vec3 extent = maxPos - minPos;
+	vec3 normal = normalize(N);
+	//half a probe spacing off the surface, so the probes just behind it lose their trilinear weight
+	vec3 pos = (fragPos - minPos) / extent + normal * (0.5 / float(probes));
+	vec3 g = pos * float(probes) - 0.5;
+	ivec3 base = ivec3(floor(g));
+	vec3 f = g - vec3(base);
+
+	vec3 sum = vec3(0.0);
+	float total = 0.0;
+	for (int i = 0; i != 8; i++)
+	{
+		ivec3 offset = ivec3(i & 1, (i >> 1) & 1, i >> 2);
+		ivec3 c = clamp(base + offset, ivec3(0), ivec3(probes - 1));
+		vec3 trilinear = mix(1.0 - f, f, vec3(offset));
+		float w = trilinear.x * trilinear.y * trilinear.z;
+
+		vec3 toProbe = (vec3(c) + 0.5) / float(probes) - pos;
+		float dist = length(toProbe);
+		vec3 dir = dist > 0.0 ? toProbe / dist : normal;
+		//a probe behind the surface sees the other side of it
+		float facing = dot(dir, normal);
+		w *= facing > 0.0 ? facing + 0.1 : 0.01;
+		//the probe's free distance towards fragPos, blended over the axes it points along
+		vec3 away = -dir;
+		vec3 freePositive = texelFetch(probeTex, c + ivec3(0, 0, 4 * probes), 0).xyz;
+		vec3 freeNegative = texelFetch(probeTex, c + ivec3(0, 0, 5 * probes), 0).xyz;
+		float free = dot(away * away, mix(freeNegative, freePositive, step(0.0, away)));
+		if (dist > free + 0.5 / float(probes))
+			w *= 0.01;
+
+		vec4 L00 = texelFetch(probeTex, c, 0);
+		vec4 L1y = texelFetch(probeTex, c + ivec3(0, 0, probes), 0);
+		vec4 L1z = texelFetch(probeTex, c + ivec3(0, 0, 2 * probes), 0);
+		vec4 L1x = texelFetch(probeTex, c + ivec3(0, 0, 3 * probes), 0);
+		//L1 convolved with the clamped cosine, band factors pi and 2pi/3, over pi
+		vec4 E = max(0.282095 * L00 + (2.0 / 3.0) * 0.488603 * (L1y * normal.y + L1z * normal.z + L1x * normal.x), vec4(0.0));
+		sum += w * E.rgb * (1.0 - min(E.a, 1.0));
+		total += w;
+	}
+	return total > 0.0 ? sum / total : vec3(0.0);
 }
+#endif
+
+#if PASS == PASS_COMPOSITE
+//joint bilateral upsample: bilinear weights of the four nearest low resolution texels, cut down where the
+//G-buffer texel they were traced at lies at another depth or faces another way
+vec3 upsampleIndirect(ivec2 p, vec3 fragPos, vec3 N)
+{
+	if (scale == 1)
+		return texelFetch(indirect, p, 0).rgb;
+	vec2 coord = (vec2(p) + 0.5) / float(scale) - 0.5;
+	ivec2 base = ivec2(floor(coord));
+	vec2 f = coord - vec2(base);
+	ivec2 size = textureSize(indirect, 0);
+	float depth = distance(fragPos, viewPos);
+	vec3 normal = normalize(N);
+
+	vec3 sum = vec3(0.0);
+	float total = 0.0;
+	vec3 closest = vec3(0.0);
+	float best = 0.0;
+	for (int i = 0; i != 4; i++)
+	{
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 q = clamp(base + offset, ivec2(0), size - 1);
+		vec4 s = texelFetch(indirect, q, 0);
+		if (s.a == 0.0)
+			continue;
+		ivec2 g = min(q * scale + scale / 2, textureSize(gPosition, 0) - 1);
+		float sampleDepth = distance(texelFetch(gPosition, g, 0).xyz, viewPos);
+		vec3 sampleNormal = normalize(texelFetch(gNormal, g, 0).xyz);
+		float similarity = exp(-abs(sampleDepth - depth) / (0.05 * depth)) * pow(max(dot(normal, sampleNormal), 0.0), 8.0);
+		float w = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y) * similarity;
+		sum += w * s.rgb;
+		total += w;
+		if (similarity > best)
+		{
+			best = similarity;
+			closest = s.rgb;
+		}
+	}
+	//no neighbour on this surface: the most similar one rather than black
+	return total > 1e-4 ? sum / total : closest;
+}
+#endif
 
 vec3 posTransToNdc(vec3 pos)
 {
@@ -92,21 +325,44 @@ vec3 posTransToNdc(vec3 pos)
 	return result;
 }
 
-vec4 coneTracing(vec3 direction, vec3 N, float tanValue)
+vec4 coneTracing(vec3 fragPos, vec3 direction, vec3 N, float tanValue)
 {
 	float voxelSize = (maxPos-minPos).x/Step;
-	vec3 start = fs_in.fragPos+N*voxelSize;
+	float MAX_LENGTH = maxDistance > 0.0 ? maxDistance : length(maxPos-minPos) * float(1 << max(clipmapLevels - 1, 0));
+	vec3 start = fragPos+N*voxelSize;
 	
 	vec3 color = vec3(0.0);
 	float alpha =0.0;
 	float occlusion=0.0;
 	float t = voxelSize;
+	float nextQuery = 0.0;
 	while(alpha<MAX_ALPHA && t<MAX_LENGTH)
 	{
 		float d = max(voxelSize, 2.0*t*tanValue);
 		float mip = log2(d/voxelSize);
+#ifndef OCTREE_STORAGE
+		if (useOccupancy && t >= nextQuery)
+		{
+			//every sample before the jump is empty and adds nothing
+			float skip = emptySpace((start+t*direction-minPos)/voxelSize, direction, t, mip, tanValue, voxelSize);
+			if (skip > 0.0)
+			{
+				t += max(skip, d*stepValue);
+				continue;
+			}
+			nextQuery = t - skip;
+		}
+#endif
 		vec3 texCoord3D= posTransToNdc(start+t*direction);
-		vec4 result = textureLod(tex,texCoord3D,mip);
+		vec4 result;
+#ifdef OCTREE_STORAGE
+		result = textureOctree(texCoord3D,mip);
+#else
+		if (clipmapLevels > 0)
+			result = textureClipmap(start+t*direction,mip,direction);
+		else
+			result = textureVolume(texCoord3D,mip,direction);
+#endif
 		color += (1.0-alpha)*result.a*result.rgb;
 		alpha += (1.0-alpha)*result.a;
 		occlusion +=(1.0-occlusion)*result.a/(1.0+lambda*t);
@@ -115,19 +371,99 @@ vec4 coneTracing(vec3 direction, vec3 N, float tanValue)
 	return vec4(color,occlusion); 
 }
 
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewPos, vec3 fragPos)
+#ifdef OCTREE_STORAGE
+//filtered lookup in the brick of the node at depth, empty space has no node
+vec4 sampleOctree(vec3 p, int depth)
+{
+	if (any(lessThan(p, vec3(0.0))) || any(greaterThanEqual(p, vec3(1.0))))
+		return vec4(0.0);
+	uvec3 voxel = uvec3(p * Step);
+	uint node = 0u;
+	for (int k = 0; k != depth; k++)
+	{
+		uint child = nodes[node] & 0x7FFFFFFFu;
+		if (child == 0u)
+			return vec4(0.0);
+		uvec3 bit = (voxel >> uint(octreeLevels - 1 - k)) & 1u;
+		node = child + bit.x + bit.y * 2u + bit.z * 4u;
+	}
+	uint B = uint(brickPoolSize);
+	vec3 origin = vec3(node % B, (node / B) % B, node / (B * B)) * 2.0;
+	vec3 local = fract(p * float(1 << depth));
+	return textureLod(brickPool, (origin + 0.5 + clamp(local * 2.0 - 0.5, 0.0, 1.0)) / float(2 * brickPoolSize), 0.0);
+}
+
+//depth levels-1 bricks hold mip 0 of the dense volume, the root brick the coarsest mip
+vec4 textureOctree(vec3 p, float mip)
+{
+	float depth = clamp(float(octreeLevels - 1) - mip, 0.0, float(octreeLevels - 1));
+	int coarse = int(floor(depth));
+	vec4 result = sampleOctree(p, coarse);
+	if (depth > float(coarse))
+		result = mix(result, sampleOctree(p, coarse + 1), depth - float(coarse));
+	return result;
+}
+#else
+//the finest level containing pos, coarser when the cone is wider than its voxels;
+//within a level the mip in [0,1) blends towards the next level's resolution
+vec4 textureClipmap(vec3 pos, float lod, vec3 direction)
+{
+	vec3 extent = maxPos - minPos;
+	int level = clipmapLevels;
+	vec3 local;
+	for (int i = clamp(int(floor(lod)), 0, clipmapLevels - 1); i < clipmapLevels; i++)
+	{
+		local = (pos - clipMin[i]) / (extent * float(1 << i));
+		if (all(greaterThanEqual(local, vec3(0.0))) && all(lessThan(local, vec3(1.0))))
+		{
+			level = i;
+			break;
+		}
+	}
+	if (level == clipmapLevels)
+		return vec4(0.0);
+
+	//x and y wrap in hardware, z keeps the filter footprint inside the level's slab
+	vec3 wrapped = fract(pos / (extent * float(1 << level)));
+	float mip = max(lod - float(level), 0.0);
+	float border = 0.5 * exp2(ceil(mip)) / float(Step);
+	wrapped.z = clamp(wrapped.z, border, 1.0 - border);
+	return textureVolume(vec3(wrapped.xy, (float(level) + wrapped.z) / float(clipmapLevels)), mip, direction);
+}
+
+//the three directional mips facing the cone, weighted by the squared direction
+vec4 textureVolume(vec3 texCoord, float mip, vec3 direction)
+{
+	if (!anisotropic || mip <= 0.0)
+		return textureLod(tex, texCoord, mip);
+
+	vec3 d = normalize(direction);
+	vec3 w = d * d;
+	float anisoMip = max(mip - 1.0, 0.0);
+	vec4 result = w.x * (d.x > 0.0 ? textureLod(anisoTex[0], texCoord, anisoMip) : textureLod(anisoTex[1], texCoord, anisoMip))
+		+ w.y * (d.y > 0.0 ? textureLod(anisoTex[2], texCoord, anisoMip) : textureLod(anisoTex[3], texCoord, anisoMip))
+		+ w.z * (d.z > 0.0 ? textureLod(anisoTex[4], texCoord, anisoMip) : textureLod(anisoTex[5], texCoord, anisoMip));
+	//below the first directional level blend from the voxels themselves
+	if (mip < 1.0)
+		result = mix(textureLod(tex, texCoord, 0.0), result, mip);
+	return result;
+}
+#endif
+
+#if PASS != PASS_DIFFUSE
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewPos, vec3 fragPos, vec3 albedo, vec3 specularColor, float shininess, vec4 fragPosLightSpace)
 {
 	//diffuse
 	vec3 lightDir = normalize(-light.direction);
 	float diff = max(dot(normal, lightDir), 0.0);
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, fs_in.texCoord));
+	vec3 diffuse = light.diffuse * diff * albedo;
 	//specular
 	vec3 viewDir = normalize(viewPos - fragPos);
 	vec3 halfwayDir = normalize(viewDir + lightDir);
-	float spec = pow(max(dot(halfwayDir, normal), 0.0), material.shininess);
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, fs_in.texCoord));
+	float spec = pow(max(dot(halfwayDir, normal), 0.0), shininess);
+	vec3 specular = light.specular * spec * specularColor;
 
-	float shadow = ShadowCalculation(fs_in.fragPosLightSpace, normal, lightDir);
+	float shadow = coneShadows ? ShadowCone(fragPos, normal, lightDir) : ShadowCalculation(fragPosLightSpace, normal, lightDir);
 
 	return  (1.0 - shadow) * (diffuse + specular);
 }
@@ -160,4 +496,5 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
 		shadow = 0.0f;
 
 	return shadow;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
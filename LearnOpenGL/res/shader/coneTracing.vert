@@ -11,12 +11,23 @@ out VS_OUT{
 } vs_out;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
+#define FRAME_BLOCK
+#define LIGHT_BLOCK
+#include "uniformBlocks.glsl"
+//deferred passes draw one full screen triangle without vertex attributes
+uniform bool fullscreen;
+//the depth pre-pass (depth.vert) computes the same position, DrawObject may test against it with GL_EQUAL
+invariant gl_Position;
 
 void main()
 {
+	if (fullscreen)
+	{
+		vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+		gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+		vs_out.texCoord = p;
+		return;
+	}
 	gl_Position = projection * view * model * vec4(aPos, 1.0f);
 	vs_out.fragPos = vec3(model * vec4(aPos, 1.0f));
 	vs_out.normal = normalize(transpose(inverse(mat3(model))) * aNorm);
@@ -0,0 +1,6 @@
+#version 450 core
+//depth pre-pass, no colour output
+
+void main()
+{
+}
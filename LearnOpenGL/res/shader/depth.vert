@@ -0,0 +1,14 @@
+#version 450 core
+layout(location = 0) in vec3 aPos;
+
+uniform mat4 model;
+#define FRAME_BLOCK
+#include "uniformBlocks.glsl"
+
+//must match coneTracing.vert bit for bit, the shading pass tests against this depth with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPos, 1.0f);
+}
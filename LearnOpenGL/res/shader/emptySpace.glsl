@@ -0,0 +1,48 @@
+//Empty space skipping over the occupancy pyramid of occupancy.comp, dense storage only; a level l texel covers
+//(4 << l)^3 voxels. Included after the Step declaration
+uniform bool useOccupancy;
+uniform usampler3D occupancy;
+uniform int occupancyLevels;
+
+//how far a cone at voxel (in voxels of the volume) can advance from t before a sample may read an occupied voxel;
+//if the sample at t may, minus how far it should march before asking again. direction is per unit of t.
+//A mip m sample reads up to 1.5 * 2^ceil(m) voxels away, so the 2x2x2 level l cells (4 << l voxels) around voxel
+//cover every sample in their central cell sized box while ceil(m) <= l; the coarsest empty level wins
+float emptySpace(vec3 voxel, vec3 direction, float t, float mip, float tanValue, float voxelSize)
+{
+	if (any(lessThan(voxel, vec3(0.0))) || any(greaterThanEqual(voxel, vec3(Step))))
+		return 0.0;
+	float skip = 0.0;
+	for (int l = max(int(ceil(mip)), 0); l < occupancyLevels; l++)
+	{
+		//the cell holding voxel first, most samples near geometry stop there
+		float cell = float(4 << l);
+		if (texelFetch(occupancy, ivec3(voxel) >> (l + 2), l).r != 0u)
+			return skip > 0.0 ? skip : -0.5 * cell * voxelSize / length(direction);
+		ivec3 first = ivec3(floor(voxel / cell - 0.5));
+		bool empty = true;
+		for (int i = 0; i != 8 && empty; i++)
+		{
+			ivec3 c = first + ivec3(i & 1, (i >> 1) & 1, i >> 2);
+			if (all(greaterThanEqual(c, ivec3(0))) && all(lessThan(c, ivec3(Step >> (l + 2)))))
+				empty = texelFetch(occupancy, c, l).r == 0u;
+		}
+		if (!empty)
+			return skip > 0.0 ? skip : -0.5 * cell * voxelSize / length(direction);
+
+		//to the far side of the central box, or where the cone grows past mip l
+		vec3 lo = (vec3(first) + 0.5) * cell;
+		vec3 dir = direction / voxelSize;
+		float exit = 1e30;
+		for (int i = 0; i != 3; i++)
+		{
+			if (dir[i] > 0.0)
+				exit = min(exit, (lo[i] + cell - voxel[i]) / dir[i]);
+			else if (dir[i] < 0.0)
+				exit = min(exit, (lo[i] - voxel[i]) / dir[i]);
+		}
+		float wideT = exp2(float(l)) * voxelSize / (2.0 * max(tanValue, 1e-4));
+		skip = max(min(exit, wideT - t), 0.0);
+	}
+	return skip;
+}
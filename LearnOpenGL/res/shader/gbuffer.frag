@@ -0,0 +1,30 @@
+#version 450 core
+//G-buffer of the deferred cone tracing path, read by PASS_DIFFUSE and PASS_COMPOSITE of coneTracing.frag
+layout(location = 0) out vec4 gPosition;
+layout(location = 1) out vec4 gNormal;
+layout(location = 2) out vec4 gAlbedo;
+layout(location = 3) out vec4 gSpecular;
+
+in VS_OUT{
+	vec3 fragPos;
+	vec3 normal;
+	vec2 texCoord;
+	vec4 fragPosLightSpace;
+} fs_in;
+
+struct Material {
+	sampler2D diffuse;
+	sampler2D specular;
+	float roughness;
+	float shininess;
+};
+uniform Material material;
+
+void main()
+{
+	//a = 0 marks texels no object covers
+	gPosition = vec4(fs_in.fragPos, 1.0);
+	gNormal = vec4(fs_in.normal, material.roughness);
+	gAlbedo = vec4(texture(material.diffuse, fs_in.texCoord).rgb, 1.0);
+	gSpecular = vec4(texture(material.specular, fs_in.texCoord).rgb, material.shininess);
+}
@@ -11,7 +11,8 @@ out VS_OUT{
 }vs_out;
 
 uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
+#define LIGHT_BLOCK
+#include "uniformBlocks.glsl"
 
 void main()
 {
@@ -10,7 +10,9 @@ in VS_OUT{
 	vec4 fragPosLightSpace;
 } fs_in;
 
-uniform vec2 samples[256];
+#define LIGHT_BLOCK
+#define SAMPLE_BLOCK
+#include "uniformBlocks.glsl"
 
 uniform sampler2D gPositionDepth;
 uniform sampler2D gNormal;
@@ -26,14 +28,6 @@ struct Material {
 };
 uniform Material material;
 
-struct DirLight {
-	vec3 direction;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-uniform DirLight dirlight;
 
 const float PI= 3.14159265359;
 const float rmax = 0.3; 
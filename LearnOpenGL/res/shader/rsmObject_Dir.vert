@@ -13,7 +13,8 @@ out VS_OUT{
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
+#define LIGHT_BLOCK
+#include "uniformBlocks.glsl"
 
 void main()
 {
@@ -8,7 +8,8 @@ in vec3 fragPos;
 in vec3 normal;
 
 uniform sampler2D texture_diffuse;
-uniform vec3 light;
+#define LIGHT_BLOCK
+#include "uniformBlocks.glsl"
 const float NEAR = 0.1; // ͶӰĽƽ
 const float FAR = 1000.0f; // ͶӰԶƽ
 
@@ -23,5 +24,5 @@ void main()
 
     gNormal = normalize(normal);
 
-    gFlux.rgb = light * texture(texture_diffuse, texCoord).rgb / PI;
+    gFlux.rgb = dirlight.diffuse * texture(texture_diffuse, texCoord).rgb / PI;
 }
\ No newline at end of file
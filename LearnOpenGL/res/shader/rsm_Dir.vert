@@ -7,7 +7,8 @@ out vec3 fragPos;
 out vec3 normal;
 out vec2 texCoord;
 
-uniform mat4 lightSpaceMatrix;
+#define LIGHT_BLOCK
+#include "uniformBlocks.glsl"
 uniform mat4 model;
 
 void main()
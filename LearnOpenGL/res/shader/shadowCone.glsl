@@ -0,0 +1,30 @@
+//Cone-traced shadows, see DirVXGI::SetConeShadows: the light's visibility through the R8 opacity volume of
+//opacity.comp instead of the RSM depth. Included after the minPos, maxPos and Step declarations
+//In the voxelization shaders the volume is the previous completed one, so a moved object is shadowed by
+//where it was until the next volume is built
+uniform bool coneShadows;
+uniform sampler3D opacity;
+uniform float shadowTan;
+uniform float shadowStep;
+
+//one narrow cone towards the light through the dense minPos/maxPos box, widening into a penumbra with distance
+float ShadowCone(vec3 fragPos, vec3 normal, vec3 lightDir)
+{
+	float voxelSize = (maxPos - minPos).x / Step;
+	//off the surface by two voxels so the fragment's own voxel does not shadow it
+	vec3 start = fragPos + normal * 2.0 * voxelSize;
+
+	float alpha = 0.0;
+	float t = voxelSize;
+	while (alpha < 1.0)
+	{
+		vec3 texCoord = (start + t * lightDir - minPos) / (maxPos - minPos);
+		if (any(lessThan(texCoord, vec3(0.0))) || any(greaterThan(texCoord, vec3(1.0))))
+			break;
+		float d = max(voxelSize, 2.0 * t * shadowTan);
+		float a = textureLod(opacity, texCoord, log2(d / voxelSize)).r;
+		alpha += (1.0 - alpha) * a;
+		t += d * shadowStep;
+	}
+	return alpha;
+}
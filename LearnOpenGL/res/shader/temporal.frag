@@ -0,0 +1,78 @@
+#version 450 core
+//temporal accumulation of the jittered diffuse cones of the deferred path, one texel per low resolution texel.
+//The history is reprojected with last frame's view-projection; a texel whose surface was not there last frame,
+//by distance to the camera or normal, restarts from this frame.
+//Colour and occlusion of the cones are averaged apart and the occlusion applied after, as diffuseCones does
+layout(location = 0) out vec4 history;
+layout(location = 1) out vec4 guide;
+layout(location = 2) out vec4 cones;
+
+//this frame's cones: weighted rgb, a = 1 + weighted occlusion, a = 0 where the G-buffer is empty
+uniform sampler2D current;
+//the occluded rgb the composite reads, a = frames accumulated
+uniform sampler2D previous;
+//normal and distance to the camera of the surface accumulated in previous
+uniform sampler2D previousGuide;
+//accumulated rgb and occlusion of the cones
+uniform sampler2D previousCones;
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform int scale;
+uniform bool historyValid;
+uniform int maxHistory;
+uniform mat4 prevViewProjection;
+#define FRAME_BLOCK
+#include "uniformBlocks.glsl"
+uniform vec3 prevViewPos;
+
+void main()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	ivec2 size = textureSize(current, 0);
+	vec4 s = texelFetch(current, p, 0);
+	if (s.a == 0.0)
+	{
+		history = vec4(0.0);
+		guide = vec4(0.0);
+		cones = vec4(0.0);
+		return;
+	}
+	vec4 value = vec4(s.rgb, s.a - 1.0);
+	//the G-buffer texel the cones were traced at
+	ivec2 g = min(p * scale + scale / 2, textureSize(gPosition, 0) - 1);
+	vec3 pos = texelFetch(gPosition, g, 0).xyz;
+	vec3 normal = normalize(texelFetch(gNormal, g, 0).xyz);
+	guide = vec4(normal, distance(pos, viewPos));
+
+	vec4 clip = prevViewProjection * vec4(pos, 1.0);
+	ivec2 q = ivec2(floor((clip.xy / clip.w * 0.5 + 0.5) * vec2(size)));
+	float lastFrames = 0.0;
+	if (historyValid && clip.w > 0.0 && all(greaterThanEqual(q, ivec2(0))) && all(lessThan(q, size)))
+	{
+		vec4 lastGuide = texelFetch(previousGuide, q, 0);
+		float depth = distance(pos, prevViewPos);
+		if (abs(lastGuide.w - depth) < 0.1 * depth && dot(lastGuide.xyz, normal) > 0.9)
+			lastFrames = texelFetch(previous, q, 0).a;
+	}
+	if (lastFrames == 0.0)
+	{
+		cones = value;
+		history = vec4(value.rgb * (1.0 - min(value.a, 1.0)), 1.0);
+		return;
+	}
+
+	//clamped to what this frame's neighbourhood traced, so lighting that changed does not linger
+	vec4 lo = value, hi = value;
+	for (int i = 0; i != 9; i++)
+	{
+		vec4 n = texelFetch(current, clamp(p + ivec2(i % 3 - 1, i / 3 - 1), ivec2(0), size - 1), 0);
+		if (n.a > 0.0)
+		{
+			lo = min(lo, vec4(n.rgb, n.a - 1.0));
+			hi = max(hi, vec4(n.rgb, n.a - 1.0));
+		}
+	}
+	float frames = min(lastFrames + 1.0, float(maxHistory));
+	cones = mix(clamp(texelFetch(previousCones, q, 0), lo, hi), value, 1.0 / frames);
+	history = vec4(cones.rgb * (1.0 - min(cones.a, 1.0)), frames);
+}
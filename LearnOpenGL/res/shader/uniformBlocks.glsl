@@ -0,0 +1,42 @@
+//The std140 blocks of UniformBlocks.h, at the binding points of UniformBlockBinding. A shader defines the
+//blocks it reads before including this, the others would clash with its plain uniforms of the same names
+
+#ifdef FRAME_BLOCK
+//camera, shared by every pass of the frame
+layout(std140, binding = 0) uniform FrameBlock {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+};
+#endif
+
+#ifdef LIGHT_BLOCK
+struct DirLight {
+	vec3 direction;
+
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+//the light and its RSM projection
+layout(std140, binding = 1) uniform LightBlock {
+	DirLight dirlight;
+	mat4 lightSpaceMatrix;
+};
+#endif
+
+#ifdef VOLUME_BLOCK
+//the box cone tracing reads
+layout(std140, binding = 2) uniform VolumeBlock {
+	vec3 minPos;
+	int Step;
+	vec3 maxPos;
+};
+#endif
+
+#ifdef SAMPLE_BLOCK
+//RSM sampling pattern
+layout(std140, binding = 3) uniform SampleBlock {
+	vec2 samples[256];
+};
+#endif
@@ -0,0 +1,143 @@
+#version 450 core
+//Voxel ambient occlusion, the cheap tier of DirVXGI: the diffuse cones only accumulate opacity from the R8 volume
+//written by opacity.comp, with no radiance fetches and no specular cone; what they leave scales the light's ambient term
+out vec4 fragColor;
+
+#define FRAME_BLOCK
+#define LIGHT_BLOCK
+#define VOLUME_BLOCK
+#include "uniformBlocks.glsl"
+
+in VS_OUT{
+	vec3 fragPos;
+	vec3 normal;
+	vec2 texCoord;
+	vec4 fragPosLightSpace;
+} fs_in;
+
+struct Material {
+	sampler2D diffuse;
+	sampler2D specular;
+	float roughness;
+	float shininess;
+};
+uniform Material material;
+
+uniform sampler2D gPositionDepth;
+#include "shadowCone.glsl"
+
+//runtime cone parameters, see ConeSettings in VXGI.h
+uniform float lambda;
+uniform float stepValue;
+uniform float maxDistance;
+uniform float diffuseTan;
+uniform int diffuseConeCount;
+
+vec3 coneDirections[6] = {vec3(0, 0, 1),
+                          vec3(0, 0.866025,0.5),
+                          vec3(0.823639, 0.267617, 0.5),
+                          vec3(0.509037, -0.700629, 0.5),
+                          vec3(-0.509037, -0.700629, 0.5),
+                          vec3(-0.823639, 0.267617, 0.5)};
+float weight[6] =  {1.0/4.0,
+					3.0/20.0,
+					3.0/20.0,
+					3.0/20.0,
+					3.0/20.0,
+					3.0/20.0};
+const float MAX_ALPHA = 1.0;
+float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir);
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewPos, vec3 fragPos, vec3 albedo, vec3 specularColor, float shininess, vec4 fragPosLightSpace);
+float occlusionCone(vec3 direction, vec3 N, float tanValue);
+
+void main()
+{
+	vec3 normal = normalize(fs_in.normal);
+	vec3 tangent = normal.z > 0.001 ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
+	vec3 bitangent = cross(normal, tangent);
+	tangent = cross(bitangent, normal);
+	mat3 TBN = mat3(tangent, bitangent, normal);
+
+	float occlusion = 0.0;
+	float total = 0.0;
+	for (int i = 0; i != diffuseConeCount; i++)
+	{
+		occlusion += occlusionCone(normalize(TBN * coneDirections[i]), fs_in.normal, diffuseTan) * weight[i];
+		total += weight[i];
+	}
+	occlusion /= total;
+
+	vec3 albedo = texture(material.diffuse, fs_in.texCoord).rgb;
+	vec3 ambient = dirlight.ambient * albedo * (1.0 - occlusion);
+	vec3 direct = calcDirLight(dirlight, fs_in.normal, viewPos, fs_in.fragPos, albedo, texture(material.specular, fs_in.texCoord).rgb, material.shininess, fs_in.fragPosLightSpace);
+	fragColor = vec4(ambient + direct, 1.0);
+}
+
+//the occlusion accumulator of coneTracing() in coneTracing.frag, one channel per sample
+float occlusionCone(vec3 direction, vec3 N, float tanValue)
+{
+	float voxelSize = (maxPos - minPos).x / Step;
+	float MAX_LENGTH = maxDistance > 0.0 ? maxDistance : length(maxPos - minPos);
+	vec3 start = fs_in.fragPos + N * voxelSize;
+
+	float alpha = 0.0;
+	float occlusion = 0.0;
+	float t = voxelSize;
+	while (alpha < MAX_ALPHA && t < MAX_LENGTH)
+	{
+		float d = max(voxelSize, 2.0 * t * tanValue);
+		float mip = log2(d / voxelSize);
+		float a = textureLod(opacity, (start + t * direction - minPos) / (maxPos - minPos), mip).r;
+		alpha += (1.0 - alpha) * a;
+		occlusion += (1.0 - occlusion) * a / (1.0 + lambda * t);
+		t += d * stepValue;
+	}
+	return occlusion;
+}
+
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewPos, vec3 fragPos, vec3 albedo, vec3 specularColor, float shininess, vec4 fragPosLightSpace)
+{
+	//diffuse
+	vec3 lightDir = normalize(-light.direction);
+	float diff = max(dot(normal, lightDir), 0.0);
+	vec3 diffuse = light.diffuse * diff * albedo;
+	//specular
+	vec3 viewDir = normalize(viewPos - fragPos);
+	vec3 halfwayDir = normalize(viewDir + lightDir);
+	float spec = pow(max(dot(halfwayDir, normal), 0.0), shininess);
+	vec3 specular = light.specular * spec * specularColor;
+
+	float shadow = coneShadows ? ShadowCone(fragPos, normal, lightDir) : ShadowCalculation(fragPosLightSpace, normal, lightDir);
+
+	return  (1.0 - shadow) * (diffuse + specular);
+}
+
+float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	vec3 projCoord = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	projCoord = projCoord * 0.5 + 0.5;
+	float currentDepth = projCoord.z;
+	float shadow = 0.0f;
+
+	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+
+	//PCF
+	vec2 texelSize = 1.0 / textureSize(gPositionDepth, 0);
+	for (int i = 0; i != 3; i++)
+	{
+		for (int j = 0; j != 3; j++)
+		{
+			float pcfDepth = texture(gPositionDepth, projCoord.xy + vec2(i, j) * texelSize).a;
+
+			shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;;
+		}
+	}
+	
+	shadow /= 9.0;
+
+	//Զ
+	if (projCoord.z > 1.0f)
+		shadow = 0.0f;
+
+	return shadow;
+}
@@ -0,0 +1,9 @@
+#version 450 core
+out vec4 fragColor;
+
+flat in vec3 color;
+
+void main()
+{
+	fragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 450 core
+layout(location = 0) in vec3 aPos;
+
+//one unit cube instance per entry of the list built by voxelList.comp
+layout(std430, binding = 8) readonly buffer VoxelList {
+	uint command[8];
+	uint voxels[];
+};
+
+uniform sampler3D tex;
+uniform int mip;
+uniform vec3 minPos;
+uniform vec3 maxPos;
+uniform mat4 view;
+uniform mat4 projection;
+
+flat out vec3 color;
+
+void main()
+{
+	uint v = voxels[gl_InstanceID];
+	ivec3 p = ivec3(v & 0x3FFu, (v >> 10u) & 0x3FFu, v >> 20u);
+	vec3 voxelSize = (maxPos - minPos) / vec3(textureSize(tex, mip));
+	gl_Position = projection * view * vec4(minPos + (vec3(p) + 0.5 + aPos) * voxelSize, 1.0);
+	color = texelFetch(tex, p, mip).rgb;
+}
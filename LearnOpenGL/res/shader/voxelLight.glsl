@@ -0,0 +1,45 @@
+//The direct light both voxelizers store, shared by image3D.frag and voxelize.comp. Included after the minPos, maxPos
+//and Step declarations; the shaders sample the material themselves, the fragment stage with derivatives
+struct Material {
+	sampler2D diffuse;
+	sampler2D specular;
+	float shininess;
+};
+uniform Material material;
+
+#define LIGHT_BLOCK
+#include "uniformBlocks.glsl"
+
+uniform vec3 viewPos;
+uniform sampler2D gPositionDepth;
+#include "shadowCone.glsl"
+
+//PCF over the RSM depth, which has no mip levels
+float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	vec3 projCoord = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	projCoord = projCoord * 0.5 + 0.5;
+	float currentDepth = projCoord.z;
+	float shadow = 0.0f;
+
+	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+
+	//PCF
+	vec2 texelSize = 1.0 / textureSize(gPositionDepth, 0);
+	for (int i = 0; i != 3; i++)
+	{
+		for (int j = 0; j != 3; j++)
+		{
+			float pcfDepth = textureLod(gPositionDepth, projCoord.xy + vec2(i, j) * texelSize, 0.0).a;
+
+			shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+		}
+	}
+
+	shadow /= 9.0;
+
+	if (projCoord.z > 1.0f)
+		shadow = 0.0f;
+
+	return shadow;
+}
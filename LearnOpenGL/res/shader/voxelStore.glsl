@@ -0,0 +1,89 @@
+//Writing a voxel fragment to the volume, shared by image3D.frag, voxelize.comp and inject.comp. Included after the
+//minPos, maxPos and Step declarations
+layout(binding = 0, r32ui) uniform volatile coherent uimage3D tex;
+//octree storage: voxels are appended here instead of written to tex, see svo.comp
+layout(std430, binding = 3) buffer FragmentList {
+	uint fragmentCount;
+	uint maxFragments;
+	uint staticFragmentCount;
+	uint fragmentPad;
+	uvec2 fragments[];
+};
+uniform bool fragmentList;
+//clipmap storage: slab of the stacked volume this level is written to
+uniform int clipLevel;
+//toroidal addressing: the level's origin in voxels modulo Step, so a voxel keeps its texel while the level scrolls
+uniform ivec3 wrapOffset;
+//only voxels in [regionMin, regionMax) are written, the slabs exposed by a scroll
+uniform ivec3 regionMin;
+uniform ivec3 regionMax;
+//fixed-point accumulation: per voxel sums of r, g, b and a fragment count, normalized by resolve.comp
+layout(std430, binding = 6) buffer Accumulator {
+	uint accum[];
+};
+//voxels hit since the last resolve, with its indirect dispatch arguments
+layout(std430, binding = 7) buffer TouchedVoxels {
+	uint resolveGroupsX;
+	uint resolveGroupsY;
+	uint resolveGroupsZ;
+	uint touchedCount;
+	uint touched[];
+};
+uniform bool accumulate;
+const float ACCUMULATION_SCALE = 1024.0;
+
+//adds val to voxel p's sums, the voxel's first fragment since the last resolve appends it to the touched list
+void accumulateVoxel(ivec3 p, vec3 val)
+{
+	uint voxel = uint(p.x + Step * (p.y + Step * p.z));
+	uvec3 c = uvec3(clamp(val, 0.0, 1.0) * ACCUMULATION_SCALE + 0.5);
+	atomicAdd(accum[voxel * 4u], c.r);
+	atomicAdd(accum[voxel * 4u + 1u], c.g);
+	atomicAdd(accum[voxel * 4u + 2u], c.b);
+	if (atomicAdd(accum[voxel * 4u + 3u], 1u) == 0u)
+	{
+		uint n = atomicAdd(touchedCount, 1u);
+		touched[n] = voxel;
+		if (n % 64u == 0u)
+			atomicAdd(resolveGroupsX, 1u);
+	}
+}
+
+void imageAtomicRGBA8Avg(ivec3 coords, vec4 val)
+{
+	uint newVal = packUnorm4x8(val);
+	uint prevStoredVal = 0;
+	uint curStoredVal;
+	// Loop as long as destination value gets changed by other threads
+	while ((curStoredVal = imageAtomicCompSwap(tex, coords, prevStoredVal, newVal)) != prevStoredVal)
+	{
+		prevStoredVal = curStoredVal;
+		vec4 rval = unpackUnorm4x8(curStoredVal);
+		rval.w *= 256.0;
+		rval.xyz = (rval.xyz * rval.w); // Denormalize
+		vec4 curValF = rval + val; // Add new value
+		curValF.xyz /= (curValF.w); // Renormalize
+		curValF.w /= 256.0;
+		newVal = packUnorm4x8(curValF);
+	}
+}
+
+//one fragment of voxel p: averaged into tex, summed in the accumulator or appended to the fragment list
+void storeVoxel(ivec3 p, vec4 val)
+{
+	if (any(lessThan(p, regionMin)) || any(greaterThanEqual(p, regionMax)))
+		return;
+	if (accumulate)
+	{
+		accumulateVoxel(p, val.rgb);
+		return;
+	}
+	if (!fragmentList)
+	{
+		imageAtomicRGBA8Avg((p + wrapOffset) % Step + ivec3(0, 0, clipLevel * Step), val);
+		return;
+	}
+	uint id = atomicAdd(fragmentCount, 1u);
+	if (id < maxFragments)
+		fragments[id] = uvec2(uint(p.x) | uint(p.y) << 10u | uint(p.z) << 20u, packUnorm4x8(val));
+}
@@ -0,0 +1,175 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <iostream>
+#include "VXGI.h"
+
+enum GovernorPass
+{
+	GovernorVoxelization = 0, GovernorConeTracing, GovernorPassCount
+};
+
+//Holds the GI passes to a GPU frame-time target by trading cone and RSM quality.
+//Quality moves between Cheapest (0) and Best (1) in 1/Steps increments, only when the measured time leaves the
+//Hysteresis band around TargetMs and Cooldown frames after the last move, so it does not oscillate.
+//GL_TIME_ELAPSED queries around the governed passes are read FRAMES_IN_FLIGHT frames later without stalling
+class QualityGovernor
+{
+public:
+	static const unsigned int FRAMES_IN_FLIGHT = 4;
+
+	QualityGovernor(DirVXGI* vxgi, float targetMs);
+	~QualityGovernor();
+
+	//around the Voxelization and DrawObject calls, not nested
+	void Begin(GovernorPass pass);
+	void End();
+	//once per frame after the governed passes
+	void Update();
+
+	float TargetMs;
+	float Hysteresis = 0.1f;
+	unsigned int Cooldown = 8;
+	unsigned int Steps = 8;
+	//knobs at quality 1 and 0, Best starts as the renderer's current settings
+	ConeSettings Best, Cheapest;
+	unsigned int BestRSMResolution, CheapestRSMResolution = 128;
+
+	float Quality = 1.0f;
+	//latest measurement with the current quality, smoothed
+	double PassMs[GovernorPassCount] = { 0.0 };
+	double FrameMs = 0.0;
+	unsigned int Changes = 0;
+
+private:
+	void Apply();
+
+	DirVXGI* ourVXGI;
+	unsigned int queries[FRAMES_IN_FLIGHT][GovernorPassCount];
+	bool issued[FRAMES_IN_FLIGHT][GovernorPassCount] = {};
+	unsigned int slotFrame[FRAMES_IN_FLIGHT] = { 0 };
+	bool pending[FRAMES_IN_FLIGHT] = {};
+	unsigned int frame = 0, lastChange = 0, samples = 0;
+	int level;
+	int active = -1;
+};
+
+QualityGovernor::QualityGovernor(DirVXGI* vxgi, float targetMs)
+	:TargetMs(targetMs), ourVXGI(vxgi)
+{
+	glGenQueries(FRAMES_IN_FLIGHT * GovernorPassCount, &queries[0][0]);
+
+	Best = ourVXGI->Cones;
+	BestRSMResolution = ourVXGI->ourRSM->Resolution();
+	Cheapest = Best;
+	Cheapest.StepValue = 0.3f;
+	Cheapest.DiffuseAperture = 45.0f;
+	Cheapest.DiffuseCones = 1;
+	level = Steps;
+}
+
+QualityGovernor::~QualityGovernor()
+{
+	glDeleteQueries(FRAMES_IN_FLIGHT * GovernorPassCount, &queries[0][0]);
+}
+
+void QualityGovernor::Begin(GovernorPass pass)
+{
+	if (active >= 0)
+	{
+		std::cout << "ERROR::GOVERNOR::PASSES_MAY_NOT_NEST" << std::endl;
+		return;
+	}
+	unsigned int slot = frame % FRAMES_IN_FLIGHT;
+	glBeginQuery(GL_TIME_ELAPSED, queries[slot][pass]);
+	issued[slot][pass] = true;
+	active = pass;
+}
+
+void QualityGovernor::End()
+{
+	if (active < 0)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	active = -1;
+}
+
+void QualityGovernor::Update()
+{
+	unsigned int slot = frame % FRAMES_IN_FLIGHT;
+	slotFrame[slot] = frame;
+	pending[slot] = true;
+	frame++;
+
+	//the oldest frame in flight, its slot is reused next frame whether or not it finished
+	slot = frame % FRAMES_IN_FLIGHT;
+	bool fresh = false;
+	if (pending[slot])
+	{
+		bool available = true;
+		for (int pass = 0; pass != GovernorPassCount; pass++)
+		{
+			GLuint done = 1;
+			if (issued[slot][pass])
+				glGetQueryObjectuiv(queries[slot][pass], GL_QUERY_RESULT_AVAILABLE, &done);
+			available = available && done;
+		}
+		//frames rendered before the last change say nothing about the current quality
+		if (available && slotFrame[slot] >= lastChange)
+		{
+			double total = 0.0;
+			for (int pass = 0; pass != GovernorPassCount; pass++)
+			{
+				GLuint64 ns = 0;
+				if (issued[slot][pass])
+					glGetQueryObjectui64v(queries[slot][pass], GL_QUERY_RESULT, &ns);
+				double ms = (double)ns / 1.0e6;
+				PassMs[pass] = samples == 0 ? ms : glm::mix(PassMs[pass], ms, 0.5);
+				total += ms;
+			}
+			FrameMs = samples == 0 ? total : glm::mix(FrameMs, total, 0.5);
+			samples++;
+			fresh = true;
+		}
+		pending[slot] = false;
+		for (int pass = 0; pass != GovernorPassCount; pass++)
+			issued[slot][pass] = false;
+	}
+
+	if (!fresh || frame - lastChange < Cooldown)
+		return;
+	int next = level;
+	if (FrameMs > TargetMs * (1.0f + Hysteresis))
+		next = glm::max(level - 1, 0);
+	else if (FrameMs < TargetMs * (1.0f - Hysteresis))
+		next = glm::min(level + 1, (int)Steps);
+	if (next == level)
+		return;
+
+	level = next;
+	Quality = (float)level / (float)Steps;
+	Apply();
+	lastChange = frame;
+	samples = 0;
+	Changes++;
+}
+
+void QualityGovernor::Apply()
+{
+	ConeSettings& cones = ourVXGI->Cones;
+	cones.StepValue = glm::mix(Cheapest.StepValue, Best.StepValue, Quality);
+	cones.Lambda = glm::mix(Cheapest.Lambda, Best.Lambda, Quality);
+	cones.DiffuseAperture = glm::mix(Cheapest.DiffuseAperture, Best.DiffuseAperture, Quality);
+	cones.DiffuseCones = (unsigned int)glm::round(glm::mix((float)Cheapest.DiffuseCones, (float)Best.DiffuseCones, Quality));
+	//0 is the whole volume, only blend when both bounds are set
+	bool bounded = Cheapest.MaxDistance > 0.0f && Best.MaxDistance > 0.0f;
+	cones.MaxDistance = bounded ? glm::mix(Cheapest.MaxDistance, Best.MaxDistance, Quality) : Quality == 1.0f ? Best.MaxDistance : Cheapest.MaxDistance;
+
+	//RSM texels scale with the square of the side, blend the side geometrically in steps of 32
+	float side = glm::exp2(glm::mix(glm::log2((float)CheapestRSMResolution), glm::log2((float)BestRSMResolution), Quality));
+	ourVXGI->SetRSMResolution(glm::max(32u, (unsigned int)glm::round(side / 32.0f) * 32u));
+}
+
+#endif
@@ -10,7 +10,10 @@
 #include <vector>
 #include "../object.h"
 #include "../light.h"
+#include "../profiler.h"
+#include "UniformBlocks.h"
 #include<random>
+#include<memory>
 
 using std::shared_ptr;
 using std::vector;
@@ -28,22 +31,46 @@ public:
 	void SetTwoPass() {
 		onePass = false;
 	}
+	void SetProfiler(GpuProfiler* profiler) {
+		ourProfiler = profiler;
+	}
+	//reallocates the RSM targets, their contents are undefined until the next DrawRSM
+	void SetResolution(unsigned int width, unsigned int height);
+	unsigned int Resolution() const {
+		return SHADOW_WIDTH;
+	}
 	void DrawRSM(vector<Object> objects)  override;
 	void DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 viewPos, glm::mat4 view, glm::mat4 projection, unsigned int SCR_WIDTH = 800, unsigned int SCR_HEIGHT = 600) override;
+	//moves the light, the next DrawRSM renders from the new position
+	void SetLight(DirLight _light, glm::vec3 _position)
+	{
+		light = _light;
+		position = _position;
+		UpdateLightSpaceMatrix();
+	}
+	//writes light and lightSpaceMatrix to the LightBlock every shader reads them from and binds it, uploads only after a change.
+	//Every pass reading the block calls it first, so a direct write to light or lightSpaceMatrix is seen by the next one
+	void UpdateLightBlock();
 private:
 	void GetFramebuffer();
+	void UpdateLightSpaceMatrix();
 	void GetSamples();
 	
 	bool onePass = true;
+	GpuProfiler* ourProfiler = nullptr;
 	glm::vec3 position;
 	float near_plane, far_plane;
 	unsigned int SHADOW_WIDTH = 512, SHADOW_HEIGHT = 512, FIRST_WIDTH = 400, FIRST_HEIGHT = 300;
 	Shader shadowmapShader = Shader("res/shader/rsm_Dir.vert", "res/shader/rsm_Dir.frag");
 	Shader shadowObjectShader = Shader("res/shader/rsmObject_Dir.vert", "res/shader/rsmObject_Dir.frag");
 	Shader shadowObjectPass2Shader = Shader("res/shader/rsmObject_Dir.vert", "res/shader/rsmObjectPass2_Dir.frag");
+	ObjectUniforms shadowmapUniforms = ObjectUniforms(shadowmapShader), shadowObjectUniforms = ObjectUniforms(shadowObjectShader),
+		shadowObjectPass2Uniforms = ObjectUniforms(shadowObjectPass2Shader);
 	
 	
 	vector<glm::vec2> Samples;
+	UniformBlock lightBlock = UniformBlock(LightBlockBinding, sizeof(LightBlock));
+	UniformBlock sampleBlock = UniformBlock(SampleBlockBinding, sizeof(SampleBlock));
 public:
 	glm::mat4 lightSpaceMatrix;
 	unsigned int RSMFBO, depthMap, RSM_PositionDepth, RSM_Normal, RSM_Flux, Pass1FBO, Pass1Map, Pass1Pos, Pass1Norm;
@@ -57,10 +84,15 @@ DirRSM::DirRSM(DirLight _light, glm::vec3 _position, float near, float far)
 	GetSamples();
 
 	light = DirLight(_light);
+	UpdateLightSpaceMatrix();
+}
 
+void DirRSM::UpdateLightSpaceMatrix()
+{
 	glm::mat4 lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
 	glm::mat4 lightView = glm::lookAt(position, position + light.Direction, glm::vec3(0.0f, 1.0f, 0.0f));
 	lightSpaceMatrix = lightProjection * lightView;
+	UpdateLightBlock();
 }
 
 void DirRSM::GetSamples()
@@ -80,6 +112,23 @@ void DirRSM::GetSamples()
 			Samples.push_back(sample);
 		}
 	}
+
+	//the pattern never changes, upload it once
+	SampleBlock block;
+	for (unsigned int i = 0; i != Samples.size(); i++)
+		block.Samples[i] = glm::vec4(Samples[i], 0.0f, 0.0f);
+	sampleBlock.Update(&block);
+}
+
+void DirRSM::UpdateLightBlock()
+{
+	LightBlock block{};
+	block.Direction = light.Direction;
+	block.Ambient = light.Ambient;
+	block.Diffuse = light.Diffuse;
+	block.Specular = light.Specular;
+	block.LightSpaceMatrix = lightSpaceMatrix;
+	lightBlock.Update(&block);
 }
 
 void DirRSM::GetFramebuffer()
@@ -173,8 +222,27 @@ void DirRSM::GetFramebuffer()
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void DirRSM::SetResolution(unsigned int width, unsigned int height)
+{
+	SHADOW_WIDTH = width;
+	SHADOW_HEIGHT = height;
+
+	//mutable storage, the attachments of RSMFBO stay valid
+	glBindTexture(GL_TEXTURE_2D, depthMap);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, RSM_PositionDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, RSM_Normal);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, RSM_Flux);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void DirRSM::DrawRSM(vector<Object> objects)
 {
+	GpuScope scope(ourProfiler, "rsm");
+
 	glBindFramebuffer(GL_FRAMEBUFFER, RSMFBO);
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
@@ -185,18 +253,14 @@ void DirRSM::DrawRSM(vector<Object> objects)
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 
+	UpdateLightBlock();
+	shadowmapShader.use();
+	shadowmapShader.setInt("texture_diffuse", 0);
 	for (unsigned int i = 0; i != objects.size(); i++)
 	{
-		shadowmapShader.use();
-
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, objects[i].texture_diffuse);
-		shadowmapShader.setInt("texture_diffuse", 0);
-
-		shadowmapShader.setMat4("lightSpaceMatrix", glm::value_ptr(lightSpaceMatrix));
-		shadowmapShader.setMat4("model", glm::value_ptr(objects[i].model));
-
-		shadowmapShader.setVec3("light", light.Diffuse);
+		shadowmapShader.setMat4(shadowmapUniforms.model, glm::value_ptr(objects[i].model));
 
 		glBindVertexArray(objects[i].VAO);
 		glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
@@ -208,6 +272,10 @@ void DirRSM::DrawRSM(vector<Object> objects)
 
 void DirRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 viewPos, glm::mat4 view, glm::mat4 projection, unsigned int SCR_WIDTH, unsigned int SCR_HEIGHT)
 {
+	GpuScope scope(ourProfiler, "rsm_shading");
+	UpdateLightBlock();
+	sampleBlock.Bind();
+
 	if (onePass)
 	{
 		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
@@ -229,24 +297,13 @@ void DirRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 view
 
 		shadowObjectShader.use();
 
-		shadowObjectShader.setVec3("dirlight.ambient", light.Ambient);
-		shadowObjectShader.setVec3("dirlight.diffuse", light.Diffuse);
-		shadowObjectShader.setVec3("dirlight.specular", light.Specular);
-		shadowObjectShader.setVec3("dirlight.direction", light.Direction);
-
-		shadowObjectShader.setFloat("material.shininess", 32.0f);
+		shadowObjectShader.setFloat(shadowObjectUniforms.shininess, 32.0f);
 		shadowObjectShader.setVec3("viewPos", viewPos);
 
-		shadowObjectShader.setMat4("lightSpaceMatrix", glm::value_ptr(lightSpaceMatrix));
 		shadowObjectShader.setMat4("view", glm::value_ptr(view));
 		shadowObjectShader.setMat4("projection", glm::value_ptr(projection));
 		shadowObjectShader.setBool("onePass", onePass);
 
-		for (unsigned int i = 0; i != 256; i++)
-		{
-			shadowObjectShader.setVec2(("samples[" + std::to_string(i) + "]").c_str(), Samples[i]);
-		}
-
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, RSM_PositionDepth);
 		glActiveTexture(GL_TEXTURE1);
@@ -261,12 +318,12 @@ void DirRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 view
 		{
 			glActiveTexture(GL_TEXTURE3);
 			glBindTexture(GL_TEXTURE_2D, objects[i].texture_diffuse);
-			shadowObjectShader.setInt("material.diffuse", 3);
+			shadowObjectShader.setInt(shadowObjectUniforms.diffuse, 3);
 			glActiveTexture(GL_TEXTURE4);
 			glBindTexture(GL_TEXTURE_2D, objects[i].texture_specular);
-			shadowObjectShader.setInt("material.specular", 4);
+			shadowObjectShader.setInt(shadowObjectUniforms.specular, 4);
 
-			shadowObjectShader.setMat4("model", glm::value_ptr(objects[i].model));
+			shadowObjectShader.setMat4(shadowObjectUniforms.model, glm::value_ptr(objects[i].model));
 
 			glBindVertexArray(objects[i].VAO);
 			glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
@@ -275,6 +332,7 @@ void DirRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 view
 	else
 	{
 		//First Pass
+		GpuScope passScope(ourProfiler, "pass1");
 		glBindFramebuffer(GL_FRAMEBUFFER, Pass1FBO);
 		glViewport(0, 0, 400, 300);
 		glEnable(GL_DEPTH_TEST);
@@ -294,24 +352,13 @@ void DirRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 view
 
 		shadowObjectShader.use();
 
-		shadowObjectShader.setVec3("dirlight.ambient", light.Ambient);
-		shadowObjectShader.setVec3("dirlight.diffuse", light.Diffuse);
-		shadowObjectShader.setVec3("dirlight.specular", light.Specular);
-		shadowObjectShader.setVec3("dirlight.direction", light.Direction);
-
-		shadowObjectShader.setFloat("material.shininess", 32.0f);
+		shadowObjectShader.setFloat(shadowObjectUniforms.shininess, 32.0f);
 		shadowObjectShader.setVec3("viewPos", viewPos);
 
-		shadowObjectShader.setMat4("lightSpaceMatrix", glm::value_ptr(lightSpaceMatrix));
 		shadowObjectShader.setMat4("view", glm::value_ptr(view));
 		shadowObjectShader.setMat4("projection", glm::value_ptr(projection));
 		shadowObjectShader.setBool("onePass", onePass);
 
-		for (unsigned int i = 0; i != 256; i++)
-		{
-			shadowObjectShader.setVec2(("samples[" + std::to_string(i) + "]").c_str(), Samples[i]);
-		}
-
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, RSM_PositionDepth);
 		glActiveTexture(GL_TEXTURE1);
@@ -326,18 +373,19 @@ void DirRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 view
 		{
 			glActiveTexture(GL_TEXTURE3);
 			glBindTexture(GL_TEXTURE_2D, objects[i].texture_diffuse);
-			shadowObjectShader.setInt("material.diffuse", 3);
+			shadowObjectShader.setInt(shadowObjectUniforms.diffuse, 3);
 			glActiveTexture(GL_TEXTURE4);
 			glBindTexture(GL_TEXTURE_2D, objects[i].texture_specular);
-			shadowObjectShader.setInt("material.specular", 4);
+			shadowObjectShader.setInt(shadowObjectUniforms.specular, 4);
 
-			shadowObjectShader.setMat4("model", glm::value_ptr(objects[i].model));
+			shadowObjectShader.setMat4(shadowObjectUniforms.model, glm::value_ptr(objects[i].model));
 
 			glBindVertexArray(objects[i].VAO);
 			glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
 		}
 
 		//Second Pass
+		passScope.Next("pass2");
 		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
 		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 		glEnable(GL_DEPTH_TEST);
@@ -357,24 +405,12 @@ void DirRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 view
 
 		shadowObjectPass2Shader.use();
 
-		shadowObjectPass2Shader.setVec3("dirlight.ambient", light.Ambient);
-		shadowObjectPass2Shader.setVec3("dirlight.diffuse", light.Diffuse);
-		shadowObjectPass2Shader.setVec3("dirlight.specular", light.Specular);
-		shadowObjectPass2Shader.setVec3("dirlight.direction", light.Direction);
-
-		shadowObjectPass2Shader.setFloat("material.shininess", 32.0f);
+		shadowObjectPass2Shader.setFloat(shadowObjectPass2Uniforms.shininess, 32.0f);
 		shadowObjectPass2Shader.setVec3("viewPos", viewPos);
 
-		shadowObjectPass2Shader.setMat4("lightSpaceMatrix", glm::value_ptr(lightSpaceMatrix));
 		shadowObjectPass2Shader.setMat4("view", glm::value_ptr(view));
 		shadowObjectPass2Shader.setMat4("projection", glm::value_ptr(projection));
 
-
-		for (unsigned int i = 0; i != 256; i++)
-		{
-			shadowObjectPass2Shader.setVec2(("samples[" + std::to_string(i) + "]").c_str(), Samples[i]);
-		}
-
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, RSM_PositionDepth);
 		glActiveTexture(GL_TEXTURE1);
@@ -398,12 +434,12 @@ void DirRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 view
 		{
 			glActiveTexture(GL_TEXTURE6);
 			glBindTexture(GL_TEXTURE_2D, objects[i].texture_diffuse);
-			shadowObjectPass2Shader.setInt("material.diffuse", 6);
+			shadowObjectPass2Shader.setInt(shadowObjectPass2Uniforms.diffuse, 6);
 			glActiveTexture(GL_TEXTURE7);
 			glBindTexture(GL_TEXTURE_2D, objects[i].texture_specular);
-			shadowObjectPass2Shader.setInt("material.specular", 7);
+			shadowObjectPass2Shader.setInt(shadowObjectPass2Uniforms.specular, 7);
 
-			shadowObjectPass2Shader.setMat4("model", glm::value_ptr(objects[i].model));
+			shadowObjectPass2Shader.setMat4(shadowObjectPass2Uniforms.model, glm::value_ptr(objects[i].model));
 
 			glBindVertexArray(objects[i].VAO);
 			glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
@@ -430,6 +466,7 @@ private:
 
 	Shader shadowmapShader = Shader("res/shader/shadowMap_Dot_Vertex.shader", "res/shader/shadowMap_Dot_Geometry.shader", "res/shader/shadowMap_Dot_Fragment.shader");
 	Shader shadowObjectShader = Shader("res/shader/shadow_Dot_Vertex.shader", "res/shader/shadow_Dot_Fragment.shader");
+	ObjectUniforms shadowmapUniforms = ObjectUniforms(shadowmapShader), shadowObjectUniforms = ObjectUniforms(shadowObjectShader);
 };
 
 DotRSM::DotRSM(DotLight _light, float _near, float _far)
@@ -485,16 +522,13 @@ void DotRSM::DrawRSM(vector<Object> objects)
 	shadowmapShader.setFloat("far_plane", far);
 	shadowmapShader.setVec3("lightPos", light.Position);
 
-	for (unsigned int i = 0; i != 6; i++)
-	{
-		shadowmapShader.setMat4(("shadowMatrixs[" + std::to_string(i) + "]").c_str(), glm::value_ptr(shadowTransforms[i]));
-	}
+	shadowmapShader.setMat4Array("shadowMatrixs", shadowTransforms.data(), 6);
 
 	for (unsigned int i = 0; i != objects.size(); i++)
 	{
 		glBindVertexArray(objects[i].VAO);
 
-		shadowmapShader.setMat4("model", glm::value_ptr(objects[i].model));
+		shadowmapShader.setMat4(shadowmapUniforms.model, glm::value_ptr(objects[i].model));
 		glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
 	}
 }
@@ -505,7 +539,7 @@ void DotRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 view
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 	shadowObjectShader.use();
 
-	shadowObjectShader.setFloat("material.shininess", 32.0f);
+	shadowObjectShader.setFloat(shadowObjectUniforms.shininess, 32.0f);
 	shadowObjectShader.setVec3("viewPos", viewPos);
 
 	LightInfo info;
@@ -531,12 +565,12 @@ void DotRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 view
 		glBindTexture(GL_TEXTURE_2D, objects[i].texture_specular);
 		glActiveTexture(GL_TEXTURE2);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubeMap);
-		shadowObjectShader.setInt("material.diffuse", 0);
-		shadowObjectShader.setInt("material.specular", 1);
+		shadowObjectShader.setInt(shadowObjectUniforms.diffuse, 0);
+		shadowObjectShader.setInt(shadowObjectUniforms.specular, 1);
 		shadowObjectShader.setInt("shadowMap", 2);
 
 		glBindVertexArray(objects[i].VAO);
-		shadowObjectShader.setMat4("model", glm::value_ptr(objects[i].model));
+		shadowObjectShader.setMat4(shadowObjectUniforms.model, glm::value_ptr(objects[i].model));
 		glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
 	}
 }
@@ -564,6 +598,7 @@ private:
 
 	Shader shadowmapShader = Shader("res/shader/shadowMap_Dot_Vertex.shader", "res/shader/shadowMap_Dot_Geometry.shader", "res/shader/shadowMap_Dot_Fragment.shader");
 	Shader shadowObjectShader = Shader("res/shader/shadow_Spot_Vertex.shader", "res/shader/shadow_Spot_Fragment.shader");
+	ObjectUniforms shadowmapUniforms = ObjectUniforms(shadowmapShader), shadowObjectUniforms = ObjectUniforms(shadowObjectShader);
 };
 
 SpotRSM::SpotRSM(SpotLight _light, float _near, float _far)
@@ -619,16 +654,13 @@ void SpotRSM::DrawRSM(vector<Object> objects)
 	shadowmapShader.setFloat("far_plane", far);
 	shadowmapShader.setVec3("lightPos", light.Position);
 
-	for (unsigned int i = 0; i != 6; i++)
-	{
-		shadowmapShader.setMat4(("shadowMatrixs[" + std::to_string(i) + "]").c_str(), glm::value_ptr(shadowTransforms[i]));
-	}
+	shadowmapShader.setMat4Array("shadowMatrixs", shadowTransforms.data(), 6);
 
 	for (unsigned int i = 0; i != objects.size(); i++)
 	{
 		glBindVertexArray(objects[i].VAO);
 
-		shadowmapShader.setMat4("model", glm::value_ptr(objects[i].model));
+		shadowmapShader.setMat4(shadowmapUniforms.model, glm::value_ptr(objects[i].model));
 		glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
 	}
 }
@@ -639,7 +671,7 @@ void SpotRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 vie
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 	shadowObjectShader.use();
 
-	shadowObjectShader.setFloat("material.shininess", 32.0f);
+	shadowObjectShader.setFloat(shadowObjectUniforms.shininess, 32.0f);
 	shadowObjectShader.setVec3("viewPos", viewPos);
 
 	LightInfo info;
@@ -668,12 +700,12 @@ void SpotRSM::DrawObjects(vector<Object>objects, unsigned int FBO, glm::vec3 vie
 		glBindTexture(GL_TEXTURE_2D, objects[i].texture_specular);
 		glActiveTexture(GL_TEXTURE2);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubeMap);
-		shadowObjectShader.setInt("material.diffuse", 0);
-		shadowObjectShader.setInt("material.specular", 1);
+		shadowObjectShader.setInt(shadowObjectUniforms.diffuse, 0);
+		shadowObjectShader.setInt(shadowObjectUniforms.specular, 1);
 		shadowObjectShader.setInt("shadowMap", 2);
 
 		glBindVertexArray(objects[i].VAO);
-		shadowObjectShader.setMat4("model", glm::value_ptr(objects[i].model));
+		shadowObjectShader.setMat4(shadowObjectUniforms.model, glm::value_ptr(objects[i].model));
 		glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
 	}
 }
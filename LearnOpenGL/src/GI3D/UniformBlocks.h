@@ -0,0 +1,109 @@
+#ifndef UNIFORMBLOCKS_H
+#define UNIFORMBLOCKS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstring>
+#include "../shader.h"
+
+//binding points of the std140 blocks, the shaders declare them once in res/shader/uniformBlocks.glsl
+enum UniformBlockBinding
+{
+	FrameBlockBinding = 0, LightBlockBinding, VolumeBlockBinding, SampleBlockBinding
+};
+
+//C++ mirrors of the std140 layouts: a vec3 takes the 16 bytes of a vec4 unless a scalar follows it,
+//array elements are padded to 16 bytes
+
+//camera of the frame being drawn, written by DirVXGI::DrawObject
+struct FrameBlock
+{
+	glm::mat4 View;
+	glm::mat4 Projection;
+	glm::vec3 ViewPos;
+	float pad;
+};
+
+//the directional light and its RSM projection, written by DirRSM::UpdateLightBlock
+struct LightBlock
+{
+	glm::vec3 Direction;
+	float pad0;
+	glm::vec3 Ambient;
+	float pad1;
+	glm::vec3 Diffuse;
+	float pad2;
+	glm::vec3 Specular;
+	float pad3;
+	glm::mat4 LightSpaceMatrix;
+};
+
+//the box cone tracing reads, the front clipmap level's for clipmap storage
+struct VolumeBlock
+{
+	glm::vec3 MinPos;
+	int Step;
+	glm::vec3 MaxPos;
+	float pad;
+};
+
+//RSM sampling pattern, xy used
+struct SampleBlock
+{
+	glm::vec4 Samples[256];
+};
+
+//a uniform buffer for one of the blocks above. Update binds it to its point and uploads only when the contents changed,
+//so several passes a frame can call it without re-sending the same bytes
+class UniformBlock
+{
+public:
+	UniformBlock(unsigned int binding, unsigned int size);
+	void Update(const void* data);
+	//for blocks written once, rebinds without comparing
+	void Bind();
+	unsigned int Buffer = 0;
+private:
+	unsigned int binding, size;
+	std::vector<char> contents;
+	bool valid = false;
+};
+
+UniformBlock::UniformBlock(unsigned int _binding, unsigned int _size)
+	:binding(_binding), size(_size), contents(_size)
+{
+	glGenBuffers(1, &Buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, Buffer);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBlock::Update(const void* data)
+{
+	Bind();
+	if (valid && memcmp(contents.data(), data, size) == 0)
+		return;
+	memcpy(contents.data(), data, size);
+	glNamedBufferSubData(Buffer, 0, size, data);
+	valid = true;
+}
+
+void UniformBlock::Bind()
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, Buffer);
+}
+
+//handles of the per-object uniforms an object shader may declare, resolved once when the program is built.
+//Those the program does not declare stay at -1, and their setters do nothing
+struct ObjectUniforms
+{
+	Shader::Uniform model, diffuse, specular, shininess, roughness;
+
+	ObjectUniforms() = default;
+	explicit ObjectUniforms(const Shader& shader)
+		:model(shader.GetUniform("model")), diffuse(shader.GetUniform("material.diffuse")), specular(shader.GetUniform("material.specular")),
+		shininess(shader.GetUniform("material.shininess")), roughness(shader.GetUniform("material.roughness")) {}
+};
+
+#endif
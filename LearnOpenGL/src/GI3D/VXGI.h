@@ -10,75 +10,1669 @@
 #include "../shader.h"
 #include "../object.h"
 #include "RSM.h"
+#include "UniformBlocks.h"
+#include "../profiler.h"
 
 using std::vector;
 
 extern const unsigned int SCR_WIDTH;
 extern const unsigned int SCR_HEIGHT;
 
+enum VoxelizationMode
+{
+	RasterVoxelization = 0, ComputeVoxelization
+};
+
+enum VoxelStorage
+{
+	DenseStorage = 0, OctreeStorage, ClipmapStorage
+};
+
+//cone tracing parameters, runtime so a QualityGovernor can trade them against frame time
+struct ConeSettings
+{
+	//march step as a fraction of the cone diameter
+	float StepValue = 0.1f;
+	//how fast occlusion falls off with distance
+	float Lambda = 0.1f;
+	//march limit in world units, 0 for the whole volume
+	float MaxDistance = 0.0f;
+	//half angle of the diffuse cones in degrees
+	float DiffuseAperture = 30.0f;
+	//leading cones of the six cone diffuse set, the deferred temporal path uses ConesPerFrame instead
+	unsigned int DiffuseCones = 6;
+	//half angle in degrees and step of the cone-traced shadow, see SetConeShadows
+	float ShadowAperture = 3.0f;
+	float ShadowStep = 0.25f;
+};
+
+//handles of the ConeSettings uniforms, a program declares all of them (coneTracing.frag, voxelAO.frag) or a subset
+struct ConeUniforms
+{
+	Shader::Uniform stepValue, lambda, maxDistance, diffuseTan, diffuseConeCount, shadowTan, shadowStep;
+
+	explicit ConeUniforms(const Shader& shader)
+		:stepValue(shader.GetUniform("stepValue")), lambda(shader.GetUniform("lambda")), maxDistance(shader.GetUniform("maxDistance")),
+		diffuseTan(shader.GetUniform("diffuseTan")), diffuseConeCount(shader.GetUniform("diffuseConeCount")),
+		shadowTan(shader.GetUniform("shadowTan")), shadowStep(shader.GetUniform("shadowStep")) {}
+};
+
 class DirVXGI
 {
 public:
-	DirVXGI(unsigned int step, DirRSM* rsm, glm::vec3 _min, glm::vec3 _max)
-		:Step(step), ourRSM(rsm)
+	DirVXGI(unsigned int step, DirRSM* rsm, glm::vec3 _min, glm::vec3 _max, VoxelStorage storage = DenseStorage, unsigned int clipmapLevels = 4)
+		:ourRSM(rsm), Step(step), Storage(storage), ClipmapLevels(storage == ClipmapStorage ? clipmapLevels : 1)
 	{
 		min = _min;
 		max = _max;
+		//the deferred composite of dense storage reads 16 samplers, which GL 4.5 guarantees per fragment stage
+		int units = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+		if (units < 16)
+			std::cout << "ERROR::VXGI::CONE_TRACING_NEEDS_16_FRAGMENT_TEXTURE_UNITS " << units << std::endl;
 		GetImage3D();
 	};
 	DirRSM* ourRSM;
-	unsigned int Tex;
+	GpuProfiler* ourProfiler = nullptr;
+	unsigned int Tex = 0, StaticTex = 0;
 	unsigned int Step;
+	//octree storage: fragment list and node pool capacity, the brick pool holds BrickPoolSize^3 bricks
+	VoxelStorage Storage;
+	unsigned int MaxFragments = 1 << 22;
+	unsigned int BrickPoolSize = 96;
+	unsigned int BrickPool = 0;
+	unsigned int OctreeNodeCount();
+	//clipmap storage: nested camera-centred levels stacked along z in Tex, level i covers 2^i times the min/max box
+	unsigned int ClipmapLevels;
+	vector<glm::vec3> ClipMin;
+	//six directional mip chains (+X, -X, +Y, -Y, +Z, -Z) replacing the isotropic mips of Tex, level 0 of each is Tex mip 1
+	bool Anisotropic = false;
+	unsigned int AnisoTex[6] = { 0 };
+	void SetAnisotropic(bool anisotropic);
+	//opacity weighted compute mips instead of glGenerateMipmap, BuildMipmaps can also refresh just a dirty box of level 0
+	bool ComputeMipmaps = false;
+	void SetComputeMipmaps(bool computeMipmaps) {
+		ComputeMipmaps = computeMipmaps;
+	}
+	void BuildMipmaps(const glm::ivec3& regionMin, const glm::ivec3& regionMax);
+	//lock-free atomicAdd into fixed-point sums plus a resolve pass, instead of the RGBA8 compare-and-swap average
+	bool FixedPointAccumulation = false;
+	void SetFixedPointAccumulation(bool fixedPoint);
+	//geometry is voxelized as albedo and opacity into AlbedoTex, the light is splatted into Tex from the RSM every frame,
+	//so a light change costs the RSM and an injection dispatch instead of a revoxelization
+	bool LightInjection = false;
+	unsigned int AlbedoTex = 0;
+	void SetLightInjection(bool lightInjection);
+	//only the bricks dynamic objects left or entered are restored from the static layer, revoxelized and re-mipped
+	bool DirtyRegions = false;
+	unsigned int DirtyBrickSize = 16;
+	void SetDirtyRegions(bool dirtyRegions);
+	//with light injection on dense storage: occupied voxels cone-trace the radiance volume and feed the result back,
+	//1/BounceInterleave of them per frame, so bounces build up over frames at a fixed cost
+	bool MultiBounce = false;
+	unsigned int BounceTex = 0;
+	unsigned int BounceInterleave = 8;
+	void SetMultiBounce(bool multiBounce);
+	//GI scheduler: the RSM is redrawn every RSMInterval frames, and with VoxelizationSlices > 1 the volume is rebuilt
+	//one z slab per frame into a back buffer; the light, mip and bounce passes run once it is complete.
+	//Cone tracing reads FrontTex and FrontClipMin, the last completed volume
+	unsigned int RSMInterval = 1, VoxelizationSlices = 1;
+	unsigned int FrontTex = 0;
+	vector<glm::vec3> FrontClipMin;
+	void SetSchedule(unsigned int rsmInterval, unsigned int voxelizationSlices);
+	//dense storage: occupancy pyramid over 4^3 voxel bricks, rebuilt with the mips,
+	//lets the cone marchers jump over empty space
+	bool Occupancy = false;
+	unsigned int OccupancyTex = 0;
+	unsigned int OccupancyLevels = 0;
+	void SetOccupancy(bool occupancy);
+	//cone tracing over a G-buffer: the diffuse cones run at 1/DeferredScale resolution and are upsampled guided by
+	//depth and normal, the specular cone and direct light stay per pixel
+	bool Deferred = false;
+	unsigned int DeferredScale = 2;
+	unsigned int GBufferFBO = 0, GPosition = 0, GNormal = 0, GAlbedo = 0, GSpecular = 0;
+	unsigned int IndirectFBO = 0, IndirectTex = 0;
+	void SetDeferred(bool deferred, unsigned int scale = 2);
+	//deferred only: ConesPerFrame of the six diffuse cones, rotated every frame and accumulated over up to
+	//TemporalHistory frames in a history reprojected with the previous view-projection
+	bool Temporal = false;
+	unsigned int ConesPerFrame = 2;
+	unsigned int TemporalHistory = 16;
+	unsigned int HistoryTex[2] = { 0 }, HistoryGuide[2] = { 0 }, HistoryCones[2] = { 0 };
+	void SetTemporal(bool temporal, unsigned int conesPerFrame = 2);
+	//dense storage: a ProbeResolution^3 grid of L1 irradiance probes over the volume replaces the diffuse cones,
+	//1/ProbeInterleave of the probes are traced whenever a volume is completed
+	bool Probes = false;
+	unsigned int ProbeResolution = 16;
+	unsigned int ProbeInterleave = 8;
+	unsigned int ProbeTex = 0;
+	void SetProbes(bool probes, unsigned int resolution = 16);
+	//dense storage, cheapest GI tier: DrawObject shades with voxelAO.frag, whose diffuse cones only trace the
+	//single-channel OpacityTex and darken the light's ambient term, no radiance fetches and no specular cone
+	bool AmbientOcclusion = false;
+	unsigned int OpacityTex = 0;
+	void SetAmbientOcclusion(bool ambientOcclusion);
+	//dense storage, voxelized lighting: direct light visibility is one cone towards the light through OpacityTex
+	//instead of the RSM, which is then never drawn. Voxelization reads the previous volume's opacity
+	bool ConeShadows = false;
+	void SetConeShadows(bool coneShadows);
+	//forward and voxel AO: depth-only pass first, then the cone tracing shader runs with GL_EQUAL and no depth writes,
+	//once per visible pixel instead of once per overdrawn fragment
+	bool DepthPrepass = false;
+	void SetDepthPrepass(bool depthPrepass) {
+		DepthPrepass = depthPrepass;
+	}
+	ConeSettings Cones;
+	//the RSM is redrawn on the next Voxelization whatever RSMInterval says
+	void SetRSMResolution(unsigned int resolution);
+	VoxelizationMode Mode = RasterVoxelization;
+	unsigned int LargeTriangleThreshold = 64;
 	void Voxelization(vector<Object>objects, glm::vec3 viewPos);
 	void GetImage3D();
+	unsigned int GetVoxelTexture();
+	void SetProfiler(GpuProfiler* profiler);
+	void SetVoxelizationMode(VoxelizationMode mode) {
+		Mode = mode;
+	}
+	void InvalidateStaticLayer() {
+		staticLayerValid = false;
+	}
 	void DrawVoxel(unsigned int FBO, Object& object, int mip, const glm::mat4& view, const glm::mat4& projection);
 	void DrawVoxel(unsigned int FBO, const vector<Object>& objects, int mip, const glm::mat4& view, const glm::mat4& projection);
 	void DrawObject(const unsigned int FBO, const vector<Object>& objects, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection);
 	Shader vexShader= Shader("res/shader/image3D.vert", "res/shader/image3D.geom", "res/shader/image3D.frag");
 	Shader drawShader = Shader("res/shader/cube.vert", "res/shader/cube.frag"); 
-	Shader coneShader = Shader("res/shader/coneTracing.vert", "res/shader/coneTracing.frag");
+	//coneTracing.frag once per pass: forward, and the deferred diffuse and composite passes
+	Shader coneShader = Shader("res/shader/coneTracing.vert", "res/shader/coneTracing.frag", ConeDefines("PASS_FORWARD"));
+	Shader coneDiffuseShader = Shader("res/shader/coneTracing.vert", "res/shader/coneTracing.frag", ConeDefines("PASS_DIFFUSE"));
+	Shader coneCompositeShader = Shader("res/shader/coneTracing.vert", "res/shader/coneTracing.frag", ConeDefines("PASS_COMPOSITE"));
+	Shader compShader = Shader("res/shader/voxelize.comp");
+	Shader svoShader = Shader("res/shader/svo.comp");
+	Shader clipShader = Shader("res/shader/clipmap.comp");
+	Shader anisoShader = Shader("res/shader/aniso.comp");
+	Shader mipShader = Shader("res/shader/mipmap.comp");
+	Shader resolveShader = Shader("res/shader/resolve.comp");
+	Shader injectShader = Shader("res/shader/inject.comp");
+	Shader bounceShader = Shader("res/shader/bounce.comp");
+	Shader radianceShader = Shader("res/shader/radiance.comp");
+	Shader voxelListShader = Shader("res/shader/voxelList.comp");
+	Shader voxelCubeShader = Shader("res/shader/voxelCube.vert", "res/shader/voxelCube.frag");
+	Shader occupancyShader = Shader("res/shader/occupancy.comp");
+	Shader gbufferShader = Shader("res/shader/coneTracing.vert", "res/shader/gbuffer.frag");
+	Shader temporalShader = Shader("res/shader/coneTracing.vert", "res/shader/temporal.frag");
+	Shader probeShader = Shader("res/shader/probes.comp");
+	Shader opacityShader = Shader("res/shader/opacity.comp");
+	Shader aoShader = Shader("res/shader/coneTracing.vert", "res/shader/voxelAO.frag");
+	Shader depthShader = Shader("res/shader/depth.vert", "res/shader/depth.frag");
+	//camera and traced box, written by DrawObject for every pass that shades the frame
+	UniformBlock frameBlock = UniformBlock(FrameBlockBinding, sizeof(FrameBlock));
+	UniformBlock volumeBlock = UniformBlock(VolumeBlockBinding, sizeof(VolumeBlock));
 	glm::vec3 min, max;
-	glm::vec3 getVoxelPosition(unsigned int n, int step, int mip);
+private:
+	//handles of the uniforms set per object or per frame, initialized after the programs, which are declared first
+	ObjectUniforms vexObject = ObjectUniforms(vexShader), compObject = ObjectUniforms(compShader), coneObject = ObjectUniforms(coneShader),
+		gbufferObject = ObjectUniforms(gbufferShader), aoObject = ObjectUniforms(aoShader), depthObject = ObjectUniforms(depthShader),
+		drawObject = ObjectUniforms(drawShader);
+	ConeUniforms vexCones = ConeUniforms(vexShader), compCones = ConeUniforms(compShader), coneCones = ConeUniforms(coneShader),
+		coneDiffuseCones = ConeUniforms(coneDiffuseShader), coneCompositeCones = ConeUniforms(coneCompositeShader),
+		aoCones = ConeUniforms(aoShader), probeCones = ConeUniforms(probeShader);
+	void Voxelize(const vector<Object>& objects, const glm::vec3& viewPos, unsigned int target);
+	void VoxelizeRegion(const vector<Object>& objects, const glm::vec3& viewPos, unsigned int target, int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax);
+	void VoxelizeRaster(const vector<Object>& objects, const glm::vec3& viewPos, unsigned int target, int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax);
+	void VoxelizeCompute(const vector<Object>& objects, const glm::vec3& viewPos, unsigned int target, int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax);
+	void UpdateClipmap(const glm::vec3& viewPos);
+	void ScrollStaticLayer(const vector<Object>& staticObjects, const glm::vec3& viewPos);
+	void ClearStaticRegion(int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax);
+	void GetWrappedBoxes(int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax, vector<glm::ivec3>& starts, vector<glm::ivec3>& sizes);
+	void VoxelizeDirtyRegions(const vector<Object>& dynamicObjects, const glm::vec3& viewPos, unsigned int target, const vector<glm::vec3>& relitMin, const vector<glm::vec3>& relitMax);
+	void GetLevelBoxes(int level, const vector<glm::vec3>& boxMin, const vector<glm::vec3>& boxMax, int brick, vector<glm::ivec3>& voxelMin, vector<glm::ivec3>& voxelMax);
+	bool ShadowCastersMoved(vector<glm::vec3>& boxMin, vector<glm::vec3>& boxMax);
+	void RelightStaticShadows(const vector<Object>& staticObjects, const glm::vec3& viewPos, const vector<glm::vec3>& boxMin, const vector<glm::vec3>& boxMax);
+	glm::ivec3 WrapOffset(int level);
+	void DownsampleClipmap();
+	void GetAnisotropicMips();
+	void ResolveAccumulation(unsigned int target, int level, bool injection = false);
+	void GetAccumulationBuffers();
+	unsigned int accumulationBuffer = 0, touchedBuffer = 0;
+	void InjectLight();
+	unsigned int injectFBO = 0;
+	void GatherBounce();
+	void BuildOccupancy();
+	void UpdateProbes();
+	unsigned int probeFrame = 0;
+	bool probesValid = false;
+	void GetOpacityVolume();
+	void BuildOpacity();
+	bool opacityValid = false;
+	void SetAmbientOcclusionUniforms();
+	unsigned int bounceFrame = 0;
+	void VoxelizeSlice(const vector<Object>& dynamicObjects, const glm::vec3& viewPos, unsigned int target);
+	void FinishVolume(bool partial, GpuScope& passScope);
+	unsigned int scheduleFrame = 0, slice = 0;
+	//draw command followed by the packed coordinates of the occupied voxels, see voxelList.comp; sized for the
+	//drawn mip up to MAX_VOXEL_LIST voxels (64 MB), a full mip 0 at Step 512 would take 512 MB
+	static const unsigned int MAX_VOXEL_LIST = 1u << 24;
+	unsigned int voxelListBuffer = 0, voxelListCapacity = 0;
+	//the defines of a coneTracing.frag program, the storage decides which volume samplers it declares
+	std::vector<std::string> ConeDefines(const char* pass) const;
+	void SetConeTracingUniforms(const Shader& shader, const ConeUniforms& cones);
+	//the program must be in use
+	void SetConeSettings(const Shader& shader, const ConeUniforms& uniforms);
+	void UpdateFrameBlocks(const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection);
+	void DrawDeferred(const unsigned int FBO, const vector<Object>& objects, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection);
+	void GetGBuffer();
+	//the full screen passes draw without attributes, core profile still wants a VAO bound
+	unsigned int emptyVAO = 0;
+	void GetHistory();
+	//HistoryTex[historyIndex] is the latest, invalid until a frame has been accumulated at the current size
+	unsigned int historyFBO[2] = { 0 };
+	unsigned int historyIndex = 0, temporalFrame = 0;
+	bool historyValid = false;
+	glm::mat4 prevViewProjection;
+	glm::vec3 prevViewPos;
+	void BuildAnisotropicMips();
+	glm::vec3 LevelMin(int level);
+	glm::vec3 LevelMax(int level);
+	bool StaticLayerChanged(const vector<Object>& staticObjects);
+	void GetOctree();
+	void GetVoxelFramebuffer();
+	void BuildOctree();
+	void GetLargeTriangleBuffer(unsigned int numTriangles);
+	unsigned int largeTriangleBuffer = 0, largeTriangleCapacity = 0;
+	//GL_MAX_COMPUTE_WORK_GROUP_COUNT in x, at least 65535; the compute voxelizer's dispatches continue in y past it
+	unsigned int maxGroupsX = 0;
+	unsigned int voxelFBO;
+	unsigned int fragmentBuffer = 0, nodeBuffer = 0, octreeStateBuffer = 0;
+	enum OctreePass
+	{
+		OctreeReset = 0, OctreeFlag, OctreeAlloc, OctreeArgs, OctreeWrite, OctreeMip
+	};
+
+	//what the static layer was built from
+	bool staticLayerValid = false;
+	vector<glm::mat4> staticModels;
+	vector<unsigned int> staticVAOs;
+	LightInfo staticLight;
+	glm::mat4 staticLightSpaceMatrix;
+	vector<glm::vec3> staticClipMin;
+	//the dynamic objects the shadow source was drawn with, the RSM or with cone shadows the opacity volume,
+	//and those the static layer was lit against
+	vector<Object> shadowCasters, staticShadowCasters;
+
+	//what the dynamic objects were voxelized with, and the texels rewritten this frame
+	bool dynamicLayerValid = false;
+	vector<glm::mat4> dynamicModels;
+	vector<unsigned int> dynamicVAOs;
+	vector<glm::ivec3> dirtyStarts, dirtySizes;
 };
 
-inline glm::vec3 DirVXGI::getVoxelPosition(unsigned int n, int step, int mip)
+void DirVXGI::GetImage3D()
+{
+	if (Storage == OctreeStorage)
+	{
+		GetOctree();
+		return;
+	}
+
+	Tex = GetVoxelTexture();
+	FrontTex = Tex;
+	glBindImageTexture(0, Tex, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+	
+	//static objects only, composited under the dynamic ones every frame
+	glGenTextures(1, &StaticTex);
+	glBindTexture(GL_TEXTURE_3D, StaticTex);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA8, Step, Step, Step * ClipmapLevels);
+
+	glBindTexture(GL_TEXTURE_3D, 0);
+
+	ClipMin.assign(ClipmapLevels, min);
+	FrontClipMin = ClipMin;
+
+	GetVoxelFramebuffer();
+}
+
+unsigned int DirVXGI::GetVoxelTexture()
+{
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_3D, texture);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	//full mip chain up front so the texture is complete before the first glGenerateMipmap
+	unsigned int levels = (unsigned int)glm::log2((float)Step) + 1;
+	glTexStorage3D(GL_TEXTURE_3D, levels, GL_RGBA8, Step, Step, Step * ClipmapLevels);
+	if (Storage == ClipmapStorage)
+	{
+		//toroidal addressing, z stays clamped as the levels are stacked along it
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	}
+	glBindTexture(GL_TEXTURE_3D, 0);
+	return texture;
+}
+
+void DirVXGI::GetVoxelFramebuffer()
+{
+	//attachment-less framebuffer, the voxelization pass only writes the image
+	glGenFramebuffers(1, &voxelFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, voxelFBO);
+	glFramebufferParameteri(GL_FRAMEBUFFER, GL_FRAMEBUFFER_DEFAULT_WIDTH, Step);
+	glFramebufferParameteri(GL_FRAMEBUFFER, GL_FRAMEBUFFER_DEFAULT_HEIGHT, Step);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DirVXGI::GetOctree()
+{
+	//fragment positions are packed in 10 bits per axis
+	if (Step > 1024)
+		std::cout << "ERROR::VXGI::OCTREE_STEP_TOO_LARGE " << Step << std::endl;
+
+	//fragment list: count, capacity, static count, padding, then (packed position, RGBA8) pairs
+	unsigned int header[4] = { 0, MaxFragments, 0, 0 };
+	glGenBuffers(1, &fragmentBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, fragmentBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(header) + (GLsizeiptr)MaxFragments * 2 * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+
+	unsigned int maxNodes = BrickPoolSize * BrickPoolSize * BrickPoolSize;
+	glGenBuffers(1, &nodeBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, nodeBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)maxNodes * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+
+	//node count, fragment dispatch, per level node ranges and dispatches, see svo.comp
+	glGenBuffers(1, &octreeStateBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeStateBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (1 + 3 + 16 + 16 + 48) * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	//one 2x2x2 brick per node
+	glGenTextures(1, &BrickPool);
+	glBindTexture(GL_TEXTURE_3D, BrickPool);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA8, 2 * BrickPoolSize, 2 * BrickPoolSize, 2 * BrickPoolSize);
+	glBindTexture(GL_TEXTURE_3D, 0);
+
+	GetVoxelFramebuffer();
+}
+
+unsigned int DirVXGI::OctreeNodeCount()
+{
+	unsigned int count = 0;
+	if (octreeStateBuffer != 0)
+		glGetNamedBufferSubData(octreeStateBuffer, 0, sizeof(unsigned int), &count);
+	return count;
+}
+
+void DirVXGI::SetProfiler(GpuProfiler* profiler)
+{
+	ourProfiler = profiler;
+	ourRSM->SetProfiler(profiler);
+}
+
+void DirVXGI::UpdateClipmap(const glm::vec3& viewPos)
+{
+	//snapped to two voxels of each level so its first mip does not swim
+	for (unsigned int i = 0; i != ClipmapLevels; i++)
+	{
+		glm::vec3 extent = (max - min) * float(1 << i);
+		glm::vec3 snap = extent / float(Step) * 2.0f;
+		ClipMin[i] = glm::floor((viewPos - extent / 2.0f) / snap) * snap;
+	}
+}
+
+void DirVXGI::DownsampleClipmap()
+{
+	clipShader.use();
+	clipShader.setInt("Step", Step);
+	glBindImageTexture(1, Tex, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA8);
+	//fine to coarse, each level reads the one just written
+	for (unsigned int i = 1; i < ClipmapLevels; i++)
+	{
+		glm::vec3 voxelSize = (LevelMax(i) - LevelMin(i)) / float(Step);
+		glm::ivec3 offset = glm::ivec3(glm::round((ClipMin[i - 1] - ClipMin[i]) / voxelSize));
+		clipShader.setInt("level", i);
+		clipShader.setiVec3("offset", offset);
+		clipShader.setiVec3("wrapOffset", WrapOffset(i));
+		clipShader.setiVec3("fineWrapOffset", WrapOffset(i - 1));
+		unsigned int groups = (Step / 2 + 3) / 4;
+		glDispatchCompute(groups, groups, groups);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+glm::vec3 DirVXGI::LevelMin(int level)
+{
+	return Storage == ClipmapStorage ? ClipMin[level] : min;
+}
+
+glm::vec3 DirVXGI::LevelMax(int level)
+{
+	return Storage == ClipmapStorage ? ClipMin[level] + (max - min) * float(1 << level) : max;
+}
+
+void DirVXGI::Voxelization(vector<Object>objects, glm::vec3 viewPos)
+{
+	GpuScope scope(ourProfiler, "voxelization");
+	//the voxelization passes read the LightBlock, DirRSM re-uploads it only if the light changed since
+	ourRSM->UpdateLightBlock();
+
+	vector<Object> staticObjects, dynamicObjects;
+	for (const Object& object : objects)
+	{
+		if (object.Static)
+			staticObjects.push_back(object);
+		else
+			dynamicObjects.push_back(object);
+	}
+
+	if (scheduleFrame++ % RSMInterval == 0 && !ConeShadows)
+	{
+		ourRSM->DrawRSM(objects);
+		shadowCasters = dynamicObjects;
+	}
+
+	if (Storage == OctreeStorage)
+	{
+		//static fragments stay at the front of the list, dynamic ones are appended every frame
+		GpuScope passScope(ourProfiler, "fragment_list");
+		//the list cannot drop the fragments under a moved caster's shadow, the static ones are all lit again
+		vector<glm::vec3> shadowMin, shadowMax;
+		bool castersMoved = ShadowCastersMoved(shadowMin, shadowMax);
+		if (StaticLayerChanged(staticObjects) || castersMoved)
+		{
+			unsigned int zero = 0;
+			glNamedBufferSubData(fragmentBuffer, 0, sizeof(unsigned int), &zero);
+			Voxelize(staticObjects, viewPos, 0);
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			glCopyNamedBufferSubData(fragmentBuffer, fragmentBuffer, 0, 2 * sizeof(unsigned int), sizeof(unsigned int));
+		}
+		glCopyNamedBufferSubData(fragmentBuffer, fragmentBuffer, 2 * sizeof(unsigned int), 0, sizeof(unsigned int));
+		Voxelize(dynamicObjects, viewPos, 0);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		passScope.Next("octree_build");
+		BuildOctree();
+		return;
+	}
+
+	//a sliced build keeps its clipmap origins and static layer until it completes
+	if (slice != 0)
+	{
+		VoxelizeSlice(dynamicObjects, viewPos, LightInjection ? AlbedoTex : Tex);
+		return;
+	}
+
+	if (Storage == ClipmapStorage)
+		UpdateClipmap(viewPos);
+
+	//static layer: rebuilt only when static content or the light changes, a moving clipmap only revoxelizes what scrolled in
+	//and a moving dynamic caster only the static voxels under its old and new shadow
+	vector<glm::vec3> shadowMin, shadowMax;
+	bool castersMoved = ShadowCastersMoved(shadowMin, shadowMax);
+	bool staticUpdated = true;
+	if (StaticLayerChanged(staticObjects))
+	{
+		GpuScope layerScope(ourProfiler, "static_layer");
+		glClearTexImage(StaticTex, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		Voxelize(staticObjects, viewPos, StaticTex);
+		glMemoryBarrier(GL_ALL_BARRIER_BITS);
+	}
+	else
+	{
+		staticUpdated = staticClipMin != ClipMin;
+		if (staticUpdated)
+		{
+			GpuScope layerScope(ourProfiler, "static_scroll");
+			ScrollStaticLayer(staticObjects, viewPos);
+			glMemoryBarrier(GL_ALL_BARRIER_BITS);
+		}
+		//dirty regions restore the relit voxels with the bricks the dynamic objects touched
+		if (castersMoved)
+		{
+			GpuScope layerScope(ourProfiler, "static_shadows");
+			RelightStaticShadows(staticObjects, viewPos, shadowMin, shadowMax);
+			glMemoryBarrier(GL_ALL_BARRIER_BITS);
+		}
+	}
+	staticClipMin = ClipMin;
+
+	unsigned int geometry = LightInjection ? AlbedoTex : Tex;
+	if (VoxelizationSlices > 1)
+	{
+		VoxelizeSlice(dynamicObjects, viewPos, geometry);
+		return;
+	}
+	FrontClipMin = ClipMin;
+
+	bool partial = DirtyRegions && dynamicLayerValid && !staticUpdated && dynamicModels.size() == dynamicObjects.size();
+	GpuScope passScope(ourProfiler, partial ? "dirty_regions" : "composite");
+	if (partial)
+	{
+		//last frame's dynamic voxels stay, only the bricks that changed are rebuilt
+		VoxelizeDirtyRegions(dynamicObjects, viewPos, geometry, shadowMin, shadowMax);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+	}
+	else
+	{
+		//dynamic objects on top of a fresh copy of the static layer
+		glCopyImageSubData(StaticTex, GL_TEXTURE_3D, 0, 0, 0, 0, geometry, GL_TEXTURE_3D, 0, 0, 0, 0, Step, Step, Step * ClipmapLevels);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		passScope.Next("voxelize");
+		Voxelize(dynamicObjects, viewPos, geometry);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+	}
+	dynamicModels.clear();
+	dynamicVAOs.clear();
+	for (const Object& object : dynamicObjects)
+	{
+		dynamicModels.push_back(object.model);
+		dynamicVAOs.push_back(object.VAO);
+	}
+	dynamicLayerValid = true;
+	//the opacity volume FinishVolume builds holds the dynamic objects where they are now
+	if (ConeShadows)
+		shadowCasters = dynamicObjects;
+
+	//nothing moved: the voxels and their mips are still current
+	if (partial && dirtyStarts.empty() && !LightInjection)
+		return;
+	FinishVolume(partial, passScope);
+}
+
+void DirVXGI::VoxelizeSlice(const vector<Object>& dynamicObjects, const glm::vec3& viewPos, unsigned int target)
+{
+	//the static layer under this frame's z slab of every level, then the dynamic objects inside it
+	GpuScope passScope(ourProfiler, "voxelize_slice");
+	glm::ivec3 lo(0, 0, Step * slice / VoxelizationSlices);
+	glm::ivec3 hi(Step, Step, Step * (slice + 1) / VoxelizationSlices);
+	for (unsigned int level = 0; level != ClipmapLevels; level++)
+	{
+		vector<glm::ivec3> starts, sizes;
+		GetWrappedBoxes(level, lo, hi, starts, sizes);
+		for (unsigned int i = 0; i != starts.size(); i++)
+			glCopyImageSubData(StaticTex, GL_TEXTURE_3D, 0, starts[i].x, starts[i].y, starts[i].z,
+				target, GL_TEXTURE_3D, 0, starts[i].x, starts[i].y, starts[i].z, sizes[i].x, sizes[i].y, sizes[i].z);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		if (!dynamicObjects.empty())
+			VoxelizeRegion(dynamicObjects, viewPos, target, level, lo, hi);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	//Tex persists across slices only, dirty regions need it across frames
+	dynamicLayerValid = false;
+	slice = (slice + 1) % VoxelizationSlices;
+	if (slice != 0)
+		return;
+
+	if (ConeShadows)
+		shadowCasters = dynamicObjects;
+	FinishVolume(false, passScope);
+	//the completed volume becomes the front, the old front is rebuilt next
+	std::swap(Tex, FrontTex);
+	FrontClipMin = ClipMin;
+}
+
+//light, clipmap and mip passes over the completed geometry in Tex
+void DirVXGI::FinishVolume(bool partial, GpuScope& passScope)
+{
+	if (LightInjection)
+	{
+		passScope.Next("light_injection");
+		InjectLight();
+	}
+
+	if (Storage == ClipmapStorage)
+	{
+		passScope.Next("clipmap_downsample");
+		DownsampleClipmap();
+	}
+
+	passScope.Next("mipmap");
+	if (Anisotropic)
+	{
+		//the debug view's Tex mips are left stale, cone tracing only reads level 0 of Tex
+		BuildAnisotropicMips();
+	}
+	else if (ComputeMipmaps)
+	{
+		//the clipmap's coarser levels are downsampled as a whole, so only dense storage re-mips just the dirty bricks
+		if (partial && !LightInjection && Storage == DenseStorage)
+		{
+			for (unsigned int i = 0; i != dirtyStarts.size(); i++)
+				BuildMipmaps(dirtyStarts[i], dirtyStarts[i] + dirtySizes[i]);
+		}
+		else
+			BuildMipmaps(glm::ivec3(0), glm::ivec3(Step, Step, Step * ClipmapLevels));
+	}
+	else
+	{
+		glBindTexture(GL_TEXTURE_3D, Tex);
+		glGenerateMipmap(GL_TEXTURE_3D);
+	}
+
+	if (Occupancy)
+	{
+		passScope.Next("occupancy");
+		BuildOccupancy();
+	}
+
+	if (MultiBounce)
+	{
+		passScope.Next("bounce");
+		GatherBounce();
+	}
+
+	if (Probes)
+	{
+		passScope.Next("probes");
+		UpdateProbes();
+	}
+
+	if (AmbientOcclusion || ConeShadows)
+	{
+		passScope.Next("opacity");
+		BuildOpacity();
+	}
+}
+
+void DirVXGI::BuildMipmaps(const glm::ivec3& regionMin, const glm::ivec3& regionMax)
+{
+	mipShader.use();
+	int mipLevels = (int)glm::log2((float)Step);
+	glm::ivec3 lo = regionMin, hi = regionMax;
+	for (int level = 0; level < mipLevels;)
+	{
+		//up to four levels per dispatch, a block never spans two clipmap slabs
+		int slab = Step >> level;
+		int count = glm::min(glm::min(4, mipLevels - level), (int)glm::log2((float)slab));
+		mipShader.setiVec3("size", slab, slab, slab * ClipmapLevels);
+		mipShader.setInt("levels", count);
+
+		glBindImageTexture(1, Tex, level, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA8);
+		for (int i = 0; i != 4; i++)
+			glBindImageTexture(2 + i, Tex, level + 1 + glm::min(i, count - 1), GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+		//every workgroup covers 16^3 texels of the source level
+		glm::ivec3 groupMin = lo / 16;
+		glm::ivec3 groupMax = (hi + 15) / 16;
+		mipShader.setiVec3("groupOffset", groupMin);
+		glDispatchCompute(groupMax.x - groupMin.x, groupMax.y - groupMin.y, groupMax.z - groupMin.z);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		lo = lo >> count;
+		hi = (hi + (1 << count) - 1) >> count;
+		level += count;
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void DirVXGI::SetAnisotropic(bool anisotropic)
+{
+	if (anisotropic && Storage == OctreeStorage)
+	{
+		std::cout << "ERROR::VXGI::ANISOTROPIC_MIPS_NEED_A_VOXEL_TEXTURE" << std::endl;
+		return;
+	}
+	Anisotropic = anisotropic;
+	if (Anisotropic && AnisoTex[0] == 0)
+		GetAnisotropicMips();
+}
+
+void DirVXGI::GetAnisotropicMips()
+{
+	unsigned int levels = (unsigned int)glm::log2((float)Step);
+	glGenTextures(6, AnisoTex);
+	for (int i = 0; i != 6; i++)
+	{
+		glBindTexture(GL_TEXTURE_3D, AnisoTex[i]);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, Storage == ClipmapStorage ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, Storage == ClipmapStorage ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexStorage3D(GL_TEXTURE_3D, levels, GL_RGBA8, Step / 2, Step / 2, Step / 2 * ClipmapLevels);
+	}
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void DirVXGI::BuildAnisotropicMips()
+{
+	anisoShader.use();
+	unsigned int levels = (unsigned int)glm::log2((float)Step);
+	for (unsigned int level = 0; level != levels; level++)
+	{
+		unsigned int size = Step >> (level + 1);
+		anisoShader.setiVec3("size", size, size, size * ClipmapLevels);
+		for (int face = 0; face != 6; face++)
+		{
+			//the first level is filtered from the voxels themselves
+			if (level == 0)
+				glBindImageTexture(1, Tex, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA8);
+			else
+				glBindImageTexture(1, AnisoTex[face], level - 1, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA8);
+			glBindImageTexture(2, AnisoTex[face], level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+			anisoShader.setInt("face", face);
+			glDispatchCompute((size + 3) / 4, (size + 3) / 4, (size * ClipmapLevels + 3) / 4);
+		}
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+bool DirVXGI::StaticLayerChanged(const vector<Object>& staticObjects)
+{
+	LightInfo info;
+	ourRSM->light.GetLightInfo(info);
+
+	//an albedo layer does not depend on the light
+	bool lightChanged = staticLightSpaceMatrix != ourRSM->lightSpaceMatrix
+		|| staticLight.Direction != info.Direction || staticLight.Ambient != info.Ambient
+		|| staticLight.Diffuse != info.Diffuse || staticLight.Specular != info.Specular;
+	bool changed = !staticLayerValid || staticModels.size() != staticObjects.size() || (lightChanged && !LightInjection);
+	for (unsigned int i = 0; !changed && i != staticObjects.size(); i++)
+		changed = staticModels[i] != staticObjects[i].model || staticVAOs[i] != staticObjects[i].VAO;
+	if (!changed)
+		return false;
+
+	staticModels.clear();
+	staticVAOs.clear();
+	for (const Object& object : staticObjects)
+	{
+		staticModels.push_back(object.model);
+		staticVAOs.push_back(object.VAO);
+	}
+	staticLight = info;
+	staticLightSpaceMatrix = ourRSM->lightSpaceMatrix;
+	staticLayerValid = true;
+	return true;
+}
+
+void DirVXGI::BuildOctree()
+{
+	int levels = (int)glm::log2((float)Step);
+	svoShader.use();
+	svoShader.setInt("levels", levels);
+	svoShader.setuInt("maxNodes", BrickPoolSize * BrickPoolSize * BrickPoolSize);
+	svoShader.setInt("brickPoolSize", BrickPoolSize);
+
+	glBindImageTexture(0, BrickPool, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, fragmentBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, nodeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, octreeStateBuffer);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, octreeStateBuffer);
+
+	const GLbitfield barrier = GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_COMMAND_BARRIER_BIT;
+	const GLintptr fragmentArgs = sizeof(unsigned int);
+	const GLintptr levelArgs = (1 + 3 + 16 + 16) * sizeof(unsigned int);
+
+	svoShader.setInt("pass", OctreeReset);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(barrier);
+
+	//top down: flag the nodes the fragments fall into, then give them children
+	for (int level = 0; level < levels - 1; level++)
+	{
+		svoShader.setInt("level", level);
+		svoShader.setInt("pass", OctreeFlag);
+		glDispatchComputeIndirect(fragmentArgs);
+		glMemoryBarrier(barrier);
+		svoShader.setInt("pass", OctreeAlloc);
+		glDispatchComputeIndirect(levelArgs + level * 3 * sizeof(unsigned int));
+		glMemoryBarrier(barrier);
+		svoShader.setInt("pass", OctreeArgs);
+		glDispatchCompute(1, 1, 1);
+		glMemoryBarrier(barrier);
+	}
+
+	svoShader.setInt("pass", OctreeWrite);
+	glDispatchComputeIndirect(fragmentArgs);
+	glMemoryBarrier(barrier);
+
+	//bottom up: filter every child brick into an octant of its parent's brick
+	svoShader.setInt("pass", OctreeMip);
+	for (int level = levels - 2; level >= 0; level--)
+	{
+		svoShader.setInt("level", level);
+		glDispatchComputeIndirect(levelArgs + level * 3 * sizeof(unsigned int));
+		glMemoryBarrier(barrier);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void DirVXGI::Voxelize(const vector<Object>& objects, const glm::vec3& viewPos, unsigned int target)
+{
+	if (objects.empty())
+		return;
+	//every clipmap level is voxelized into its own slab of the target
+	for (unsigned int level = 0; level != ClipmapLevels; level++)
+		VoxelizeRegion(objects, viewPos, target, level, glm::ivec3(0), glm::ivec3(Step));
+}
+
+void DirVXGI::VoxelizeRegion(const vector<Object>& objects, const glm::vec3& viewPos, unsigned int target, int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax)
+{
+	if (Mode == ComputeVoxelization)
+		VoxelizeCompute(objects, viewPos, target, level, regionMin, regionMax);
+	else
+		VoxelizeRaster(objects, viewPos, target, level, regionMin, regionMax);
+
+	if (FixedPointAccumulation && Storage != OctreeStorage)
+	{
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		ResolveAccumulation(target, level);
+	}
+}
+
+void DirVXGI::SetFixedPointAccumulation(bool fixedPoint)
+{
+	//the octree builds its bricks from the fragment list
+	if (fixedPoint && Storage == OctreeStorage)
+	{
+		std::cout << "ERROR::VXGI::FIXED_POINT_ACCUMULATION_NEEDS_A_VOXEL_TEXTURE" << std::endl;
+		return;
+	}
+	FixedPointAccumulation = fixedPoint;
+	if (FixedPointAccumulation)
+		GetAccumulationBuffers();
+}
+
+void DirVXGI::GetAccumulationBuffers()
+{
+	if (accumulationBuffer == 0)
+	{
+		//r, g, b sums and a count per voxel of one level, zeroed again by every resolve
+		glGenBuffers(1, &accumulationBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, accumulationBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)Step * Step * Step * 4 * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+		//indirect dispatch arguments and count, then the index of every voxel hit, so the resolve stays sparse
+		const unsigned int header[4] = { 0, 1, 1, 0 };
+		glGenBuffers(1, &touchedBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, touchedBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(header) + (GLsizeiptr)Step * Step * Step * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+}
+
+void DirVXGI::ResolveAccumulation(unsigned int target, int level, bool injection)
+{
+	resolveShader.use();
+	resolveShader.setInt("Step", Step);
+	resolveShader.setInt("clipLevel", level);
+	resolveShader.setiVec3("wrapOffset", WrapOffset(level));
+	resolveShader.setBool("injection", injection);
+	glBindImageTexture(1, target, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA8);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, accumulationBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, touchedBuffer);
+
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, touchedBuffer);
+	glDispatchComputeIndirect(0);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	const unsigned int header[4] = { 0, 1, 1, 0 };
+	glNamedBufferSubData(touchedBuffer, 0, sizeof(header), header);
+}
+
+void DirVXGI::SetDirtyRegions(bool dirtyRegions)
+{
+	//the octree is rebuilt from the whole fragment list every frame
+	if (dirtyRegions && Storage == OctreeStorage)
+	{
+		std::cout << "ERROR::VXGI::DIRTY_REGIONS_NEED_A_VOXEL_TEXTURE" << std::endl;
+		return;
+	}
+	DirtyRegions = dirtyRegions;
+	dynamicLayerValid = false;
+}
+
+void DirVXGI::SetLightInjection(bool lightInjection)
+{
+	if (lightInjection && Storage == OctreeStorage)
+	{
+		std::cout << "ERROR::VXGI::LIGHT_INJECTION_NEEDS_A_VOXEL_TEXTURE" << std::endl;
+		return;
+	}
+	LightInjection = lightInjection;
+	staticLayerValid = false;
+	if (!LightInjection || AlbedoTex != 0)
+		return;
+
+	glGenTextures(1, &AlbedoTex);
+	glBindTexture(GL_TEXTURE_3D, AlbedoTex);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA8, Step, Step, Step * ClipmapLevels);
+	glBindTexture(GL_TEXTURE_3D, 0);
+
+	//layered attachment of Tex, clears its colour but not its opacity
+	glGenFramebuffers(1, &injectFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, injectFBO);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, Tex, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	GetAccumulationBuffers();
+}
+
+void DirVXGI::InjectLight()
+{
+	if (MultiBounce)
+	{
+		//opacity from the geometry, colour from the bounces gathered so far
+		radianceShader.use();
+		radianceShader.setInt("Step", Step);
+		glBindImageTexture(1, AlbedoTex, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA8);
+		glBindImageTexture(2, BounceTex, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA16F);
+		glBindImageTexture(3, Tex, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+		glDispatchCompute((Step + 3) / 4, (Step + 3) / 4, (Step + 3) / 4);
+	}
+	else
+	{
+		//opacity from the geometry, colour only where the RSM sees a surface
+		glCopyImageSubData(AlbedoTex, GL_TEXTURE_3D, 0, 0, 0, 0, Tex, GL_TEXTURE_3D, 0, 0, 0, 0, Step, Step, Step * ClipmapLevels);
+		//Tex alternates with FrontTex under a sliced schedule
+		glBindFramebuffer(GL_FRAMEBUFFER, injectFBO);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, Tex, 0);
+		glViewport(0, 0, Step, Step);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	LightInfo info;
+	ourRSM->light.GetLightInfo(info);
+	int width, height;
+	glGetTextureLevelParameteriv(ourRSM->RSM_PositionDepth, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTextureLevelParameteriv(ourRSM->RSM_PositionDepth, 0, GL_TEXTURE_HEIGHT, &height);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, ourRSM->RSM_PositionDepth);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, ourRSM->RSM_Normal);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, ourRSM->RSM_Flux);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, accumulationBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, touchedBuffer);
+
+	for (unsigned int level = 0; level != ClipmapLevels; level++)
+	{
+		injectShader.use();
+		injectShader.setInt("rsmPositionDepth", 0);
+		injectShader.setInt("rsmNormal", 1);
+		injectShader.setInt("rsmFlux", 2);
+		injectShader.setInt("Step", Step);
+		injectShader.setVec3("minPos", LevelMin(level));
+		injectShader.setVec3("maxPos", LevelMax(level));
+		injectShader.setVec3("lightDirection", info.Direction);
+		glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		ResolveAccumulation(Tex, level, true);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+void DirVXGI::SetMultiBounce(bool multiBounce)
+{
+	//the gather traces a single level 0 volume and feeds the injected radiance volume
+	if (multiBounce && (!LightInjection || Storage != DenseStorage))
+	{
+		std::cout << "ERROR::VXGI::MULTI_BOUNCE_NEEDS_LIGHT_INJECTION_AND_DENSE_STORAGE" << std::endl;
+		return;
+	}
+	MultiBounce = multiBounce;
+	if (!MultiBounce || BounceTex != 0)
+		return;
+
+	//half floats, the bounce light is often below the last RGBA8 step
+	glGenTextures(1, &BounceTex);
+	glBindTexture(GL_TEXTURE_3D, BounceTex);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA16F, Step, Step, Step);
+	glBindTexture(GL_TEXTURE_3D, 0);
+	glClearTexImage(BounceTex, 0, GL_RGBA, GL_FLOAT, nullptr);
+}
+
+void DirVXGI::SetSchedule(unsigned int rsmInterval, unsigned int voxelizationSlices)
+{
+	RSMInterval = glm::max(rsmInterval, 1u);
+	if (voxelizationSlices > 1 && Storage == OctreeStorage)
+	{
+		std::cout << "ERROR::VXGI::SLICED_VOXELIZATION_NEEDS_A_VOXEL_TEXTURE" << std::endl;
+		return;
+	}
+	//a slab is at least one voxel thick
+	VoxelizationSlices = glm::clamp(voxelizationSlices, 1u, Step);
+	slice = 0;
+	dynamicLayerValid = false;
+	if (VoxelizationSlices == 1 || FrontTex != Tex)
+		return;
+
+	//the back buffer cone tracing does not read while it is rebuilt
+	FrontTex = GetVoxelTexture();
+	glCopyImageSubData(Tex, GL_TEXTURE_3D, 0, 0, 0, 0, FrontTex, GL_TEXTURE_3D, 0, 0, 0, 0, Step, Step, Step * ClipmapLevels);
+}
+
+void DirVXGI::SetOccupancy(bool occupancy)
+{
+	//clipmap and octree lookups do not address the volume linearly
+	if (occupancy && Storage != DenseStorage)
+	{
+		std::cout << "ERROR::VXGI::OCCUPANCY_NEEDS_DENSE_STORAGE" << std::endl;
+		return;
+	}
+	Occupancy = occupancy;
+	if (!Occupancy || OccupancyTex != 0)
+		return;
+
+	//one texel per 4^3 brick down to a single texel
+	OccupancyLevels = (unsigned int)glm::log2((float)Step) - 1;
+	glGenTextures(1, &OccupancyTex);
+	glBindTexture(GL_TEXTURE_3D, OccupancyTex);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexStorage3D(GL_TEXTURE_3D, OccupancyLevels, GL_R8UI, Step / 4, Step / 4, Step / 4);
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void DirVXGI::SetDeferred(bool deferred, unsigned int scale)
+{
+	if (scale == 0)
+	{
+		std::cout << "ERROR::VXGI::DEFERRED_SCALE_MUST_BE_POSITIVE" << std::endl;
+		return;
+	}
+	Deferred = deferred;
+	if (Deferred && (GBufferFBO == 0 || scale != DeferredScale))
+	{
+		DeferredScale = scale;
+		GetGBuffer();
+	}
+}
+
+void DirVXGI::GetGBuffer()
+{
+	if (GBufferFBO == 0)
+	{
+		glGenFramebuffers(1, &GBufferFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, GBufferFBO);
+
+		//position, normal + roughness, albedo, specular + shininess
+		unsigned int* targets[4] = { &GPosition, &GNormal, &GAlbedo, &GSpecular };
+		GLenum formats[4] = { GL_RGBA32F, GL_RGBA16F, GL_RGBA8, GL_RGBA16F };
+		unsigned int attachments[4];
+		for (int i = 0; i != 4; i++)
+		{
+			glGenTextures(1, targets[i]);
+			glBindTexture(GL_TEXTURE_2D, *targets[i]);
+			glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], SCR_WIDTH, SCR_HEIGHT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, *targets[i], 0);
+			attachments[i] = GL_COLOR_ATTACHMENT0 + i;
+		}
+		glDrawBuffers(4, attachments);
+
+		//same format as the target's depth so the composite can blit it across
+		unsigned int RBO;
+		glGenRenderbuffers(1, &RBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, RBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RBO);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::VXGI::GBUFFER_NOT_COMPLETE" << std::endl;
+
+		glGenFramebuffers(1, &IndirectFBO);
+		glGenVertexArrays(1, &emptyVAO);
+	}
+
+	//rgb: diffuse cones after occlusion, a = 0 where the G-buffer is empty
+	if (IndirectTex != 0)
+		glDeleteTextures(1, &IndirectTex);
+	glGenTextures(1, &IndirectTex);
+	glBindTexture(GL_TEXTURE_2D, IndirectTex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, (SCR_WIDTH + DeferredScale - 1) / DeferredScale, (SCR_HEIGHT + DeferredScale - 1) / DeferredScale);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, IndirectFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, IndirectTex, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::VXGI::INDIRECT_TARGET_NOT_COMPLETE" << std::endl;
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (historyFBO[0] != 0)
+		GetHistory();
+}
+
+void DirVXGI::SetRSMResolution(unsigned int resolution)
+{
+	if (resolution == ourRSM->Resolution())
+		return;
+	ourRSM->SetResolution(resolution, resolution);
+	scheduleFrame = 0;
+}
+
+void DirVXGI::SetTemporal(bool temporal, unsigned int conesPerFrame)
+{
+	//the history lives at the resolution of the deferred diffuse pass
+	if (temporal && !Deferred)
+	{
+		std::cout << "ERROR::VXGI::TEMPORAL_NEEDS_DEFERRED" << std::endl;
+		return;
+	}
+	if (conesPerFrame == 0 || conesPerFrame > 6)
+	{
+		std::cout << "ERROR::VXGI::CONES_PER_FRAME_OUT_OF_RANGE " << conesPerFrame << std::endl;
+		return;
+	}
+	Temporal = temporal;
+	ConesPerFrame = conesPerFrame;
+	if (Temporal && historyFBO[0] == 0)
+		GetHistory();
+}
+
+void DirVXGI::GetHistory()
+{
+	unsigned int width = (SCR_WIDTH + DeferredScale - 1) / DeferredScale, height = (SCR_HEIGHT + DeferredScale - 1) / DeferredScale;
+	if (historyFBO[0] == 0)
+		glGenFramebuffers(2, historyFBO);
+	else
+	{
+		glDeleteTextures(2, HistoryTex);
+		glDeleteTextures(2, HistoryGuide);
+		glDeleteTextures(2, HistoryCones);
+	}
+
+	//occluded rgb + frame count, normal + distance to the camera, accumulated rgb + occlusion of the cones
+	glGenTextures(2, HistoryTex);
+	glGenTextures(2, HistoryGuide);
+	glGenTextures(2, HistoryCones);
+	for (int i = 0; i != 2; i++)
+	{
+		unsigned int targets[3] = { HistoryTex[i], HistoryGuide[i], HistoryCones[i] };
+		glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[i]);
+		for (int j = 0; j != 3; j++)
+		{
+			glBindTexture(GL_TEXTURE_2D, targets[j]);
+			glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, width, height);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + j, GL_TEXTURE_2D, targets[j], 0);
+		}
+		unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+		glDrawBuffers(3, attachments);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::VXGI::HISTORY_NOT_COMPLETE" << std::endl;
+	}
+	historyValid = false;
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DirVXGI::SetProbes(bool probes, unsigned int resolution)
+{
+	//the probe pass traces the dense volume linearly, like the bounce pass
+	if (probes && Storage != DenseStorage)
+	{
+		std::cout << "ERROR::VXGI::PROBES_NEED_DENSE_STORAGE" << std::endl;
+		return;
+	}
+	Probes = probes;
+	if (!Probes || (ProbeTex != 0 && resolution == ProbeResolution))
+		return;
+
+	ProbeResolution = resolution;
+	if (ProbeTex != 0)
+		glDeleteTextures(1, &ProbeTex);
+	//six slabs along z, see probes.comp
+	glGenTextures(1, &ProbeTex);
+	glBindTexture(GL_TEXTURE_3D, ProbeTex);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA16F, ProbeResolution, ProbeResolution, ProbeResolution * 6);
+	glBindTexture(GL_TEXTURE_3D, 0);
+	probesValid = false;
+}
+
+void DirVXGI::UpdateProbes()
+{
+	//all of them the first time
+	unsigned int interleave = probesValid ? ProbeInterleave : 1;
+	probeShader.use();
+	probeShader.setInt("Step", Step);
+	probeShader.setInt("probes", ProbeResolution);
+	SetConeSettings(probeShader, probeCones);
+	probeShader.setFloat("volumeSize", (max - min).x);
+	probeShader.setuInt("interleave", interleave);
+	probeShader.setuInt("phase", probeFrame++ % interleave);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, Tex);
+	probeShader.setInt("tex", 0);
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_3D, OccupancyTex);
+	probeShader.setInt("occupancy", 7);
+	probeShader.setBool("useOccupancy", Occupancy);
+	probeShader.setInt("occupancyLevels", OccupancyLevels);
+	probeShader.setBool("anisotropic", Anisotropic);
+	for (int i = 0; Anisotropic && i != 6; i++)
+	{
+		glActiveTexture(GL_TEXTURE1 + i);
+		glBindTexture(GL_TEXTURE_3D, AnisoTex[i]);
+	}
+	const int anisoUnits[6] = { 1, 2, 3, 4, 5, 6 };
+	if (Anisotropic)
+		probeShader.setIntArray("anisoTex", anisoUnits, 6);
+	glBindImageTexture(2, ProbeTex, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+	unsigned int count = (ProbeResolution * ProbeResolution * ProbeResolution + interleave - 1) / interleave;
+	glDispatchCompute((count + 63) / 64, 1, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	probesValid = true;
+}
+
+void DirVXGI::SetAmbientOcclusion(bool ambientOcclusion)
 {
-	step = step/glm::pow(2,mip);
-	int step2 = step * step;
-	int pz = (n - (n % step2)) / step2;
-	n %= step2;
-	int py = (n - (n % step)) / step;
-	n %= step;
-	int px = n;
+	if (ambientOcclusion && Storage != DenseStorage)
+	{
+		std::cout << "ERROR::VXGI::AMBIENT_OCCLUSION_NEEDS_DENSE_STORAGE" << std::endl;
+		return;
+	}
+	AmbientOcclusion = ambientOcclusion;
+	if (AmbientOcclusion)
+		GetOpacityVolume();
+}
 
-	glm::vec3 pos = glm::vec3(px, py, pz);
-	pos -= glm::vec3(step / 2);
-	pos /= step;
-	pos *= max - min;
-	pos += (max + min) / 2.0f;
-	return pos;
+void DirVXGI::SetConeShadows(bool coneShadows)
+{
+	if (coneShadows && Storage != DenseStorage)
+	{
+		std::cout << "ERROR::VXGI::CONE_SHADOWS_NEED_DENSE_STORAGE" << std::endl;
+		return;
+	}
+	//light injection reads the RSM flux
+	if (coneShadows && LightInjection)
+	{
+		std::cout << "ERROR::VXGI::CONE_SHADOWS_NEED_VOXELIZED_LIGHTING" << std::endl;
+		return;
+	}
+	ConeShadows = coneShadows;
+	if (ConeShadows)
+		GetOpacityVolume();
 }
 
-void DirVXGI::GetImage3D()
+void DirVXGI::GetOpacityVolume()
 {
-	glGenTextures(1, &Tex);
-	glBindTexture(GL_TEXTURE_3D, Tex);
+	if (OpacityTex != 0)
+		return;
+	glGenTextures(1, &OpacityTex);
+	glBindTexture(GL_TEXTURE_3D, OpacityTex);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	//glTexStorage3D(GL_TEXTURE_3D, 5, GL_RGBA, Step, Step, Step);
-	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA, Step, Step, Step, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-	glBindImageTexture(0, Tex, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
-	
+	int levels = (int)glm::log2((float)Step) + 1;
+	glTexStorage3D(GL_TEXTURE_3D, levels, GL_R8, Step, Step, Step);
 	glBindTexture(GL_TEXTURE_3D, 0);
+	//empty until the first volume completes, voxelization may read it before that with ConeShadows
+	for (int i = 0; i != levels; i++)
+		glClearTexImage(OpacityTex, i, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+	opacityValid = false;
 }
 
-void DirVXGI::Voxelization(vector<Object>objects, glm::vec3 viewPos)
+void DirVXGI::BuildOpacity()
+{
+	opacityShader.use();
+	opacityShader.setInt("Step", Step);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, Tex);
+	opacityShader.setInt("tex", 0);
+	glBindImageTexture(2, OpacityTex, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R8);
+
+	unsigned int groups = (Step + 3) / 4;
+	glDispatchCompute(groups, groups, groups);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	glBindTexture(GL_TEXTURE_3D, OpacityTex);
+	glGenerateMipmap(GL_TEXTURE_3D);
+
+	//the static layer was lit without any occluders the first time, light it again
+	if (!opacityValid && ConeShadows)
+		staticLayerValid = false;
+	opacityValid = true;
+}
+
+void DirVXGI::BuildOccupancy()
+{
+	occupancyShader.use();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, Tex);
+	occupancyShader.setInt("tex", 0);
+
+	for (unsigned int level = 0; level != OccupancyLevels; level++)
+	{
+		int size = (int)(Step / 4) >> level;
+		occupancyShader.setInt("pass", level == 0 ? 0 : 1);
+		occupancyShader.setiVec3("size", size, size, size);
+		glBindImageTexture(1, OccupancyTex, glm::max((int)level - 1, 0), GL_TRUE, 0, GL_READ_ONLY, GL_R8UI);
+		glBindImageTexture(2, OccupancyTex, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_R8UI);
+		glDispatchCompute((size + 3) / 4, (size + 3) / 4, (size + 3) / 4);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void DirVXGI::GatherBounce()
+{
+	bounceShader.use();
+	bounceShader.setInt("Step", Step);
+	bounceShader.setuInt("interleave", BounceInterleave);
+	bounceShader.setuInt("phase", bounceFrame++ % BounceInterleave);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, Tex);
+	bounceShader.setInt("tex", 0);
+	//an integer sampler may not share unit 0 with tex even when unused
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_3D, OccupancyTex);
+	bounceShader.setInt("occupancy", 7);
+	bounceShader.setBool("useOccupancy", Occupancy);
+	bounceShader.setInt("occupancyLevels", OccupancyLevels);
+	bounceShader.setBool("anisotropic", Anisotropic);
+	for (int i = 0; Anisotropic && i != 6; i++)
+	{
+		glActiveTexture(GL_TEXTURE1 + i);
+		glBindTexture(GL_TEXTURE_3D, AnisoTex[i]);
+	}
+	const int anisoUnits[6] = { 1, 2, 3, 4, 5, 6 };
+	if (Anisotropic)
+		bounceShader.setIntArray("anisoTex", anisoUnits, 6);
+	glBindImageTexture(1, AlbedoTex, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA8);
+	glBindImageTexture(2, BounceTex, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+	unsigned int count = (Step * Step * Step + BounceInterleave - 1) / BounceInterleave;
+	glDispatchCompute((count + 63) / 64, 1, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void DirVXGI::ScrollStaticLayer(const vector<Object>& staticObjects, const glm::vec3& viewPos)
+{
+	for (unsigned int level = 0; level != ClipmapLevels; level++)
+	{
+		glm::vec3 voxelSize = (LevelMax(level) - LevelMin(level)) / float(Step);
+		glm::ivec3 shift = glm::ivec3(glm::round((ClipMin[level] - staticClipMin[level]) / voxelSize));
+		if (shift == glm::ivec3(0))
+			continue;
+
+		//the slabs that scrolled in, disjoint: x slab first, then y and z slabs without the corners already covered
+		glm::ivec3 keepMin = glm::max(glm::ivec3(0), -shift);
+		glm::ivec3 keepMax = glm::min(glm::ivec3(Step), glm::ivec3(Step) - shift);
+		glm::ivec3 lo(0), hi(Step);
+		for (int axis = 0; axis != 3; axis++)
+		{
+			if (shift[axis] == 0)
+				continue;
+			glm::ivec3 slabMin = lo, slabMax = hi;
+			if (keepMin[axis] >= keepMax[axis])
+			{
+				slabMin[axis] = 0;
+				slabMax[axis] = Step;
+			}
+			else if (shift[axis] > 0)
+			{
+				slabMin[axis] = keepMax[axis];
+				slabMax[axis] = Step;
+			}
+			else
+			{
+				slabMin[axis] = 0;
+				slabMax[axis] = keepMin[axis];
+			}
+			ClearStaticRegion(level, slabMin, slabMax);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			VoxelizeRegion(staticObjects, viewPos, StaticTex, level, slabMin, slabMax);
+			lo[axis] = glm::max(keepMin[axis], 0);
+			hi[axis] = glm::min(keepMax[axis], (int)Step);
+			if (lo[axis] >= hi[axis])
+				break;
+		}
+	}
+}
+
+void DirVXGI::ClearStaticRegion(int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax)
+{
+	vector<glm::ivec3> starts, sizes;
+	GetWrappedBoxes(level, regionMin, regionMax, starts, sizes);
+	for (unsigned int i = 0; i != starts.size(); i++)
+		glClearTexSubImage(StaticTex, 0, starts[i].x, starts[i].y, starts[i].z,
+			sizes[i].x, sizes[i].y, sizes[i].z, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+}
+
+void DirVXGI::GetWrappedBoxes(int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax, vector<glm::ivec3>& starts, vector<glm::ivec3>& sizes)
+{
+	//the region's texels may wrap around the slab, split it into at most two ranges per axis
+	glm::ivec3 wrap = WrapOffset(level);
+	glm::ivec3 start[2], size[2];
+	int count[3];
+	for (int axis = 0; axis != 3; axis++)
+	{
+		int first = (regionMin[axis] + wrap[axis]) % Step;
+		int length = regionMax[axis] - regionMin[axis];
+		start[0][axis] = first;
+		size[0][axis] = glm::min(length, (int)Step - first);
+		start[1][axis] = 0;
+		size[1][axis] = length - size[0][axis];
+		count[axis] = size[1][axis] > 0 ? 2 : 1;
+	}
+	for (int x = 0; x != count[0]; x++)
+		for (int y = 0; y != count[1]; y++)
+			for (int z = 0; z != count[2]; z++)
+			{
+				starts.push_back(glm::ivec3(start[x].x, start[y].y, start[z].z + level * Step));
+				sizes.push_back(glm::ivec3(size[x].x, size[y].y, size[z].z));
+			}
+}
+
+void DirVXGI::VoxelizeDirtyRegions(const vector<Object>& dynamicObjects, const glm::vec3& viewPos, unsigned int target, const vector<glm::vec3>& relitMin, const vector<glm::vec3>& relitMax)
+{
+	//world boxes of the static voxels lit again this frame and those an object moved out of and into, unchanged objects add nothing
+	vector<glm::vec3> boxMin = relitMin, boxMax = relitMax, objectMin(dynamicObjects.size()), objectMax(dynamicObjects.size());
+	for (unsigned int i = 0; i != dynamicObjects.size(); i++)
+	{
+		dynamicObjects[i].GetWorldBounds(objectMin[i], objectMax[i]);
+		if (dynamicModels[i] == dynamicObjects[i].model && dynamicVAOs[i] == dynamicObjects[i].VAO)
+			continue;
+		Object previous = dynamicObjects[i];
+		previous.model = dynamicModels[i];
+		glm::vec3 previousMin, previousMax;
+		previous.GetWorldBounds(previousMin, previousMax);
+		boxMin.push_back(previousMin);
+		boxMax.push_back(previousMax);
+		boxMin.push_back(objectMin[i]);
+		boxMax.push_back(objectMax[i]);
+	}
+
+	dirtyStarts.clear();
+	dirtySizes.clear();
+	for (unsigned int level = 0; level != ClipmapLevels; level++)
+	{
+		glm::vec3 levelMin = LevelMin(level);
+		glm::vec3 voxelSize = (LevelMax(level) - levelMin) / float(Step);
+		vector<glm::ivec3> bricksMin, bricksMax;
+		GetLevelBoxes(level, boxMin, boxMax, (int)DirtyBrickSize, bricksMin, bricksMax);
+
+		for (unsigned int i = 0; i != bricksMin.size(); i++)
+		{
+			//restore the static voxels, then revoxelize every dynamic object overlapping the box
+			vector<glm::ivec3> starts, sizes;
+			GetWrappedBoxes(level, bricksMin[i], bricksMax[i], starts, sizes);
+			for (unsigned int j = 0; j != starts.size(); j++)
+				glCopyImageSubData(StaticTex, GL_TEXTURE_3D, 0, starts[j].x, starts[j].y, starts[j].z,
+					target, GL_TEXTURE_3D, 0, starts[j].x, starts[j].y, starts[j].z, sizes[j].x, sizes[j].y, sizes[j].z);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+			glm::vec3 regionMin = levelMin + glm::vec3(bricksMin[i]) * voxelSize;
+			glm::vec3 regionMax = levelMin + glm::vec3(bricksMax[i]) * voxelSize;
+			vector<Object> overlapping;
+			for (unsigned int j = 0; j != dynamicObjects.size(); j++)
+			{
+				if (glm::all(glm::lessThan(objectMin[j], regionMax)) && glm::all(glm::greaterThan(objectMax[j], regionMin)))
+					overlapping.push_back(dynamicObjects[j]);
+			}
+			if (!overlapping.empty())
+				VoxelizeRegion(overlapping, viewPos, target, level, bricksMin[i], bricksMax[i]);
+
+			dirtyStarts.insert(dirtyStarts.end(), starts.begin(), starts.end());
+			dirtySizes.insert(dirtySizes.end(), sizes.begin(), sizes.end());
+		}
+	}
+}
+
+//the voxels of level the world boxes touch, in whole bricks with one voxel of margin for conservative rasterization
+void DirVXGI::GetLevelBoxes(int level, const vector<glm::vec3>& boxMin, const vector<glm::vec3>& boxMax, int brick, vector<glm::ivec3>& voxelMin, vector<glm::ivec3>& voxelMax)
+{
+	glm::vec3 levelMin = LevelMin(level);
+	glm::vec3 voxelSize = (LevelMax(level) - levelMin) / float(Step);
+	for (unsigned int i = 0; i != boxMin.size(); i++)
+	{
+		glm::ivec3 lo = glm::ivec3(glm::floor((boxMin[i] - levelMin) / voxelSize)) - 1;
+		glm::ivec3 hi = glm::ivec3(glm::ceil((boxMax[i] - levelMin) / voxelSize)) + 1;
+		lo = glm::clamp(lo, glm::ivec3(0), glm::ivec3(Step)) / brick * brick;
+		hi = glm::clamp((hi + brick - 1) / brick * brick, glm::ivec3(0), glm::ivec3(Step));
+		if (glm::any(glm::greaterThanEqual(lo, hi)))
+			continue;
+		voxelMin.push_back(lo);
+		voxelMax.push_back(hi);
+	}
+	//overlapping boxes are merged, a voxel voxelized twice would be averaged twice
+	for (unsigned int i = 0; i < voxelMin.size(); i++)
+	{
+		for (unsigned int j = i + 1; j < voxelMin.size(); j++)
+		{
+			if (glm::any(glm::greaterThanEqual(voxelMin[i], voxelMax[j])) || glm::any(glm::greaterThanEqual(voxelMin[j], voxelMax[i])))
+				continue;
+			voxelMin[i] = glm::min(voxelMin[i], voxelMin[j]);
+			voxelMax[i] = glm::max(voxelMax[i], voxelMax[j]);
+			voxelMin.erase(voxelMin.begin() + j);
+			voxelMax.erase(voxelMax.begin() + j);
+			j = i;
+		}
+	}
+}
+
+//compares the shadow source's casters with those the static layer was lit against and records them. The world boxes
+//a moved caster's old and new shadows fall in: its bounds swept along the light across the largest level, widened by
+//the shadow cone's penumbra; a caster added or removed covers every level
+bool DirVXGI::ShadowCastersMoved(vector<glm::vec3>& boxMin, vector<glm::vec3>& boxMax)
+{
+	//an albedo layer holds no shadows
+	if (LightInjection)
+	{
+		staticShadowCasters = shadowCasters;
+		return false;
+	}
+	glm::vec3 volumeMin = LevelMin(ClipmapLevels - 1), volumeMax = LevelMax(ClipmapLevels - 1);
+	if (shadowCasters.size() != staticShadowCasters.size())
+	{
+		for (unsigned int level = 0; level != ClipmapLevels; level++)
+		{
+			volumeMin = glm::min(volumeMin, LevelMin(level));
+			volumeMax = glm::max(volumeMax, LevelMax(level));
+		}
+		boxMin.push_back(volumeMin);
+		boxMax.push_back(volumeMax);
+	}
+	else
+	{
+		glm::vec3 direction = glm::normalize(ourRSM->light.Direction);
+		float length = glm::length(volumeMax - volumeMin);
+		float penumbra = ConeShadows ? length * glm::tan(glm::radians(Cones.ShadowAperture)) : 0.0f;
+		for (unsigned int i = 0; i != shadowCasters.size(); i++)
+		{
+			if (shadowCasters[i].model == staticShadowCasters[i].model && shadowCasters[i].VAO == staticShadowCasters[i].VAO)
+				continue;
+			for (const Object* caster : { &staticShadowCasters[i], &shadowCasters[i] })
+			{
+				glm::vec3 lo, hi;
+				caster->GetWorldBounds(lo, hi);
+				boxMin.push_back(glm::min(lo, lo + direction * length) - penumbra);
+				boxMax.push_back(glm::max(hi, hi + direction * length) + penumbra);
+			}
+		}
+	}
+	staticShadowCasters = shadowCasters;
+	return !boxMin.empty();
+}
+
+void DirVXGI::RelightStaticShadows(const vector<Object>& staticObjects, const glm::vec3& viewPos, const vector<glm::vec3>& boxMin, const vector<glm::vec3>& boxMax)
 {
-	ourRSM->DrawRSM(objects);
+	for (unsigned int level = 0; level != ClipmapLevels; level++)
+	{
+		glm::vec3 levelMin = LevelMin(level);
+		glm::vec3 voxelSize = (LevelMax(level) - levelMin) / float(Step);
+		vector<glm::ivec3> voxelMin, voxelMax;
+		GetLevelBoxes(level, boxMin, boxMax, 1, voxelMin, voxelMax);
+		for (unsigned int i = 0; i != voxelMin.size(); i++)
+		{
+			ClearStaticRegion(level, voxelMin[i], voxelMax[i]);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+			//the raster voxelizer draws every object it is given whatever the region
+			glm::vec3 regionMin = levelMin + glm::vec3(voxelMin[i]) * voxelSize;
+			glm::vec3 regionMax = levelMin + glm::vec3(voxelMax[i]) * voxelSize;
+			vector<Object> overlapping;
+			for (const Object& object : staticObjects)
+			{
+				glm::vec3 objectMin, objectMax;
+				object.GetWorldBounds(objectMin, objectMax);
+				if (glm::all(glm::lessThan(objectMin, regionMax)) && glm::all(glm::greaterThan(objectMax, regionMin)))
+					overlapping.push_back(object);
+			}
+			if (!overlapping.empty())
+				VoxelizeRegion(overlapping, viewPos, StaticTex, level, voxelMin[i], voxelMax[i]);
+		}
+	}
+}
+
+glm::ivec3 DirVXGI::WrapOffset(int level)
+{
+	if (Storage != ClipmapStorage)
+		return glm::ivec3(0);
+	//the level origin in voxels, modulo Step and non-negative
+	glm::vec3 voxelSize = (LevelMax(level) - LevelMin(level)) / float(Step);
+	glm::ivec3 origin = glm::ivec3(glm::round(ClipMin[level] / voxelSize));
+	return ((origin % (int)Step) + (int)Step) % (int)Step;
+}
 
+void DirVXGI::VoxelizeRaster(const vector<Object>& objects, const glm::vec3& viewPos, unsigned int target, int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax)
+{
+	glm::vec3 min = LevelMin(level), max = LevelMax(level);
 	glm::vec3 range = max - min;
 	glm::vec3 center = (max + min) / 2.0f;
 
@@ -87,6 +1681,7 @@ void DirVXGI::Voxelization(vector<Object>objects, glm::vec3 viewPos)
 	glm::mat4 projectionY = proj * glm::lookAt(glm::vec3(center.x, max.y+0.2, center.z), center, glm::vec3(0.0, 0.0, -1.0));
 	glm::mat4 projectionZ = proj * glm::lookAt(glm::vec3(center.x, center.y, max.z+0.2), center, glm::vec3(0.0, 1.0, 0.0));
 
+	glBindFramebuffer(GL_FRAMEBUFFER, voxelFBO);
 	glViewport(0, 0, Step, Step);
 	glDisable(GL_DEPTH_TEST);
 	glDisable(GL_CULL_FACE);
@@ -94,58 +1689,156 @@ void DirVXGI::Voxelization(vector<Object>objects, glm::vec3 viewPos)
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 	glDisable(GL_CULL_FACE);
 	glDisable(GL_DEPTH_TEST);
-	glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT);
 	vexShader.use();
 
+	glBindImageTexture(0, target, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+	vexShader.setBool("fragmentList", Storage == OctreeStorage);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, fragmentBuffer);
+
 	//glActiveTexture(GL_TEXTURE0);
 	//glBindTexture(GL_TEXTURE_3D, Tex);
 	//vexShader.setInt("tex", 0);
 	vexShader.setInt("Step", Step);
 	vexShader.setVec3("minPos", min);
 	vexShader.setVec3("maxPos", max);
+	vexShader.setInt("clipLevel", level);
+	vexShader.setiVec3("wrapOffset", WrapOffset(level));
+	vexShader.setiVec3("regionMin", regionMin);
+	vexShader.setiVec3("regionMax", regionMax);
+	vexShader.setBool("accumulate", FixedPointAccumulation && Storage != OctreeStorage);
+	vexShader.setBool("albedoOnly", LightInjection);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, accumulationBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, touchedBuffer);
 
 	vexShader.setMat4("projectionX", glm::value_ptr(projectionX));
 	vexShader.setMat4("projectionY", glm::value_ptr(projectionY));
 	vexShader.setMat4("projectionZ", glm::value_ptr(projectionZ));
 
-	vexShader.setMat4("lightSpaceMatrix", glm::value_ptr(ourRSM->lightSpaceMatrix));
-
-	vexShader.setFloat("material.shininess", 32.0f);
+	vexShader.setFloat(vexObject.shininess, 32.0f);
 	vexShader.setVec3("viewPos", viewPos);
 
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, ourRSM->RSM_PositionDepth);
 	vexShader.setInt("gPositionDepth", 1);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_3D, OpacityTex);
+	vexShader.setInt("opacity", 4);
+	vexShader.setBool("coneShadows", ConeShadows);
+	SetConeSettings(vexShader, vexCones);
 
-	LightInfo info;
-	ourRSM->light.GetLightInfo(info);
-	vexShader.setVec3("dirlight.ambient", info.Ambient);
-	vexShader.setVec3("dirlight.diffuse", info.Diffuse);
-	vexShader.setVec3("dirlight.specular", info.Specular);
-	vexShader.setVec3("dirlight.direction", info.Direction);
-
+	vexShader.setInt(vexObject.diffuse, 2);
+	vexShader.setInt(vexObject.specular, 3);
 	int numObject = objects.size();
 	for (int i = 0; i != numObject; i++)
 	{
-		vexShader.setMat4("model", glm::value_ptr(objects[i].model));
+		vexShader.setMat4(vexObject.model, glm::value_ptr(objects[i].model));
 		glActiveTexture(GL_TEXTURE2);
 		glBindTexture(GL_TEXTURE_2D, objects[i].texture_diffuse);
-		vexShader.setInt("material.diffuse", 2);
 		glActiveTexture(GL_TEXTURE3);
 		glBindTexture(GL_TEXTURE_2D, objects[i].texture_specular);
-		vexShader.setInt("material.specular", 3);
 
 		glBindVertexArray(objects[i].VAO);
 		glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
 	}
+}
+
+void DirVXGI::GetLargeTriangleBuffer(unsigned int numTriangles)
+{
+	if (numTriangles <= largeTriangleCapacity)
+		return;
+	if (largeTriangleBuffer == 0)
+		glGenBuffers(1, &largeTriangleBuffer);
+	largeTriangleCapacity = numTriangles;
+
+	//three indirect dispatch arguments and the count, then one index per binned triangle
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, largeTriangleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (4 + largeTriangleCapacity) * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void DirVXGI::VoxelizeCompute(const vector<Object>& objects, const glm::vec3& viewPos, unsigned int target, int level, const glm::ivec3& regionMin, const glm::ivec3& regionMax)
+{
+	compShader.use();
+
+	compShader.setInt("Step", Step);
+	compShader.setVec3("minPos", LevelMin(level));
+	compShader.setVec3("maxPos", LevelMax(level));
+	compShader.setInt("clipLevel", level);
+	compShader.setiVec3("wrapOffset", WrapOffset(level));
+	compShader.setiVec3("regionMin", regionMin);
+	compShader.setiVec3("regionMax", regionMax);
+	compShader.setBool("accumulate", FixedPointAccumulation && Storage != OctreeStorage);
+	compShader.setBool("albedoOnly", LightInjection);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, accumulationBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, touchedBuffer);
+	compShader.setuInt("largeThreshold", LargeTriangleThreshold);
+	if (maxGroupsX == 0)
+	{
+		int count;
+		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &count);
+		maxGroupsX = count;
+	}
+	compShader.setuInt("maxGroupsX", maxGroupsX);
 
-	glBindTexture(GL_TEXTURE_3D, Tex);
-	glGenerateMipmap(GL_TEXTURE_3D);
+	compShader.setFloat(compObject.shininess, 32.0f);
+	compShader.setVec3("viewPos", viewPos);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, ourRSM->RSM_PositionDepth);
+	compShader.setInt("gPositionDepth", 1);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_3D, OpacityTex);
+	compShader.setInt("opacity", 4);
+	compShader.setBool("coneShadows", ConeShadows);
+	SetConeSettings(compShader, compCones);
+
+	glBindImageTexture(0, target, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+	compShader.setBool("fragmentList", Storage == OctreeStorage);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, fragmentBuffer);
+
+	const unsigned int dispatchReset[4] = { 0, 0, 1, 0 };
+	compShader.setInt(compObject.diffuse, 2);
+	compShader.setInt(compObject.specular, 3);
+	int numObject = objects.size();
+	for (int i = 0; i != numObject; i++)
+	{
+		unsigned int numTriangles = objects[i].Count / 3;
+		GetLargeTriangleBuffer(numTriangles);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, largeTriangleBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(dispatchReset), dispatchReset);
+
+		compShader.setMat4(compObject.model, glm::value_ptr(objects[i].model));
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, objects[i].texture_diffuse);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D, objects[i].texture_specular);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objects[i].VBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, objects[i].EBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, largeTriangleBuffer);
+
+		//small triangles one per thread, large ones are appended to the indirect dispatch
+		compShader.setInt("pass", 0);
+		compShader.setuInt("numTriangles", numTriangles);
+		unsigned int groups = (numTriangles + 63) / 64;
+		glDispatchCompute(glm::min(groups, maxGroupsX), (groups + maxGroupsX - 1) / maxGroupsX, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+		//one workgroup per large triangle, in rows of maxGroupsX
+		compShader.setInt("pass", 1);
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, largeTriangleBuffer);
+		glDispatchComputeIndirect(0);
+	}
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 void DirVXGI::DrawVoxel(unsigned int FBO, const vector<Object>& objects, int mip, const glm::mat4& view, const glm::mat4& projection)
 {
+	GpuScope scope(ourProfiler, "draw_voxel");
+	if (Storage != DenseStorage)
+		return;
+
 	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
 	glEnable(GL_DEPTH_TEST);
 
@@ -163,26 +1856,6 @@ void DirVXGI::DrawVoxel(unsigned int FBO, const vector<Object>& objects, int mip
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
-	int step = Step / glm::pow(2, mip);
-	int length = step * step * step;
-	float* Data = new float[length * 4];
-	glGetTextureImage(Tex, mip, GL_RGBA, GL_FLOAT, length * 4 * sizeof(float), Data);
-	std::vector<glm::vec3> Voxel_Positions;
-	std::vector<glm::vec3> Voxel_Colors;
-	if (Data != nullptr)
-	{
-		for (unsigned int i = 0; i < length * 4; i += 4)
-		{
-			if (Data[i + 3] == 0) continue;
-			glm::vec3 c = glm::vec3(Data[i], Data[i + 1], Data[i + 2]);
-			glm::vec3 p = getVoxelPosition(i / 4, Step, mip);
-			Voxel_Colors.push_back(c);
-			Voxel_Positions.push_back(p);
-			//std::cout << Data[i + 3] << std::endl;
-		}
-	}
-	else std::cout << "ȡʧ" << std::endl;
-	delete[] Data;
 	drawShader.use();
 
 	drawShader.setMat4("view", glm::value_ptr(view));
@@ -190,7 +1863,7 @@ void DirVXGI::DrawVoxel(unsigned int FBO, const vector<Object>& objects, int mip
 
 	
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_3D, Tex);
+	glBindTexture(GL_TEXTURE_3D, FrontTex);
 	drawShader.setInt("tex", 0);
 	//drawShader.setInt("tex", 0);
 	drawShader.setInt("Step", Step);
@@ -198,10 +1871,9 @@ void DirVXGI::DrawVoxel(unsigned int FBO, const vector<Object>& objects, int mip
 	drawShader.setVec3("maxPos", max);
 	drawShader.setInt("mip", mip);
 
-	std::cout << Voxel_Positions.size()<<std::endl;
 	for (int i = 0; i != objects.size(); i++)
 	{
-		drawShader.setMat4("model", glm::value_ptr(objects[i].model));
+		drawShader.setMat4(drawObject.model, glm::value_ptr(objects[i].model));
 
 		//drawShader.setVec3("color", Voxel_Colors[i]);
 		
@@ -213,6 +1885,10 @@ void DirVXGI::DrawVoxel(unsigned int FBO, const vector<Object>& objects, int mip
 
 void DirVXGI::DrawVoxel(unsigned int FBO, Object& object, int mip, const glm::mat4& view, const glm::mat4& projection)
 {
+	GpuScope scope(ourProfiler, "draw_voxel");
+	if (Storage != DenseStorage)
+		return;
+
 	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
 	glEnable(GL_DEPTH_TEST);
 
@@ -230,57 +1906,57 @@ void DirVXGI::DrawVoxel(unsigned int FBO, Object& object, int mip, const glm::ma
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
-	int step = Step / glm::pow(2, mip);
-	int length = step * step * step;
-	float* Data = new float[length * 4];
-	glGetTextureImage(Tex, mip, GL_RGBA, GL_FLOAT, length * 4 * sizeof(float), Data);
-	std::vector<glm::vec3> Voxel_Positions;
-	std::vector<glm::vec3> Voxel_Colors;
-	if (Data != nullptr)
+	//occupied voxels compacted on the GPU, then one instanced cube per voxel straight from that list
+	unsigned int size = glm::max(Step >> mip, 1u);
+	unsigned int capacity = glm::min(size * size * size, MAX_VOXEL_LIST);
+	if (capacity > voxelListCapacity)
 	{
-		for (unsigned int i = 0; i < length * 4; i += 4)
-		{
-			if (Data[i + 3] == 0) continue;
-			glm::vec3 c = glm::vec3(Data[i], Data[i + 1], Data[i + 2]);
-			glm::vec3 p = getVoxelPosition(i / 4, Step, mip);
-			Voxel_Colors.push_back(c);
-			Voxel_Positions.push_back(p);
-		}
+		if (voxelListBuffer == 0)
+			glGenBuffers(1, &voxelListBuffer);
+		voxelListCapacity = capacity;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, voxelListBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (8 + (GLsizeiptr)voxelListCapacity) * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 	}
-	else std::cout << "ȡʧ" << std::endl;
-	delete[] Data;
-	drawShader.use();
-
-	drawShader.setMat4("view", glm::value_ptr(view));
-	drawShader.setMat4("projection", glm::value_ptr(projection));
+	//count, instanceCount, firstIndex, baseVertex, baseInstance, then the append counter
+	const unsigned int command[8] = { object.Count, 0, 0, 0, 0, 0, 0, 0 };
+	glNamedBufferSubData(voxelListBuffer, 0, sizeof(command), command);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, voxelListBuffer);
 
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_3D, Tex);
-	drawShader.setInt("tex", 0);
-	//drawShader.setInt("tex", 0);
-	drawShader.setInt("Step", Step);
-	drawShader.setVec3("minPos", min);
-	drawShader.setVec3("maxPos", max);
-	drawShader.setInt("mip", mip);
+	glBindTexture(GL_TEXTURE_3D, FrontTex);
 
-	glm::vec3 range = max - min;
-	float _step = range.x / Step;
-	//std::cout << Voxel_Positions.size()<<std::endl;
-	for (int i = 0; i != Voxel_Colors.size(); i++)
-	{
-		object.SetModel(Voxel_Positions[i]- 0.5f * glm::vec3(_step * 0.5 * glm::pow(2, mip)), _step * 0.5 * glm::pow(2, mip));
-		drawShader.setMat4("model", glm::value_ptr(object.model));
+	voxelListShader.use();
+	voxelListShader.setInt("tex", 0);
+	voxelListShader.setInt("mip", mip);
+	voxelListShader.setuInt("capacity", voxelListCapacity);
+	glDispatchCompute((size + 3) / 4, (size + 3) / 4, (size + 3) / 4);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
 
-		drawShader.setVec3("color", Voxel_Colors[i]);
+	voxelCubeShader.use();
+	voxelCubeShader.setMat4("view", glm::value_ptr(view));
+	voxelCubeShader.setMat4("projection", glm::value_ptr(projection));
+	voxelCubeShader.setInt("tex", 0);
+	voxelCubeShader.setInt("mip", mip);
+	voxelCubeShader.setVec3("minPos", min);
+	voxelCubeShader.setVec3("maxPos", max);
 
-
-		glBindVertexArray(object.VAO);
-		glDrawElements(GL_TRIANGLES, object.Count, GL_UNSIGNED_INT, 0);
-	}
+	glBindVertexArray(object.VAO);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, voxelListBuffer);
+	glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 }
 
 void DirVXGI::DrawObject(const unsigned int FBO, const vector<Object>& objects, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection)
 {
+	GpuScope scope(ourProfiler, "cone_tracing");
+	UpdateFrameBlocks(viewPos, view, projection);
+	if (Deferred && !AmbientOcclusion)
+	{
+		DrawDeferred(FBO, objects, viewPos, view, projection);
+		return;
+	}
+
 	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
 	glEnable(GL_DEPTH_TEST);
 
@@ -296,50 +1972,285 @@ void DirVXGI::DrawObject(const unsigned int FBO, const vector<Object>& objects,
 
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
-	coneShader.use();
+	if (DepthPrepass)
+	{
+		GpuScope prepassScope(ourProfiler, "depth_prepass");
+		depthShader.use();
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthFunc(GL_LESS);
+		for (const Object& object : objects)
+		{
+			depthShader.setMat4(depthObject.model, glm::value_ptr(object.model));
+			glBindVertexArray(object.VAO);
+			glDrawElements(GL_TRIANGLES, object.Count, GL_UNSIGNED_INT, 0);
+		}
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
+
+	//the occlusion tier is forward only, its cones are cheap enough per pixel
+	Shader& shader = AmbientOcclusion ? aoShader : coneShader;
+	const ObjectUniforms& handles = AmbientOcclusion ? aoObject : coneObject;
+	shader.use();
+
+	if (AmbientOcclusion)
+		SetAmbientOcclusionUniforms();
+	else
+		SetConeTracingUniforms(coneShader, coneCones);
+	shader.setBool("fullscreen", false);
+
+	shader.setInt(handles.diffuse, 2);
+	shader.setInt(handles.specular, 3);
+	int numObjects = objects.size();
+	for (int i = 0; i != numObjects; i++)
+	{
+		shader.setMat4(handles.model, glm::value_ptr(objects[i].model));
+		shader.setFloat(handles.roughness, objects[i].Roughness);
+		shader.setFloat(handles.shininess, objects[i].Shininess);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, objects[i].texture_diffuse);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D, objects[i].texture_specular);
+
+		glBindVertexArray(objects[i].VAO);
+		glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
+	}
+
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+}
+
+//PASS is one of the PASS_ defines of coneTracing.frag
+std::vector<std::string> DirVXGI::ConeDefines(const char* pass) const
+{
+	std::vector<std::string> defines = { std::string("PASS ") + pass };
+	if (Storage == OctreeStorage)
+		defines.push_back("OCTREE_STORAGE");
+	return defines;
+}
+
+//the volume, light and storage uniforms shared by the forward and deferred passes, the program must be in use.
+//Each pass declares only the samplers it reads, setting the others is a no-op
+void DirVXGI::SetConeTracingUniforms(const Shader& shader, const ConeUniforms& cones)
+{
+	//the last completed volume, Tex may be a partly rebuilt back buffer
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, FrontTex);
+	shader.setInt("tex", 0);
+
+	if (Storage == OctreeStorage)
+	{
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_3D, BrickPool);
+		shader.setInt("brickPool", 4);
+		shader.setInt("brickPoolSize", BrickPoolSize);
+		shader.setInt("octreeLevels", (int)glm::log2((float)Step));
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, nodeBuffer);
+	}
+	shader.setBool("anisotropic", Anisotropic);
+	for (int i = 0; Anisotropic && i != 6; i++)
+	{
+		glActiveTexture(GL_TEXTURE5 + i);
+		glBindTexture(GL_TEXTURE_3D, AnisoTex[i]);
+	}
+	const int anisoUnits[6] = { 5, 6, 7, 8, 9, 10 };
+	if (Anisotropic)
+		shader.setIntArray("anisoTex", anisoUnits, 6);
+
+	glActiveTexture(GL_TEXTURE11);
+	glBindTexture(GL_TEXTURE_3D, OccupancyTex);
+	shader.setInt("occupancy", 11);
+	shader.setBool("useOccupancy", Occupancy);
+	shader.setInt("occupancyLevels", OccupancyLevels);
+
+	glActiveTexture(GL_TEXTURE19);
+	glBindTexture(GL_TEXTURE_3D, ProbeTex);
+	shader.setInt("probeTex", 19);
+	shader.setBool("useProbes", Probes);
+	shader.setInt("probes", ProbeResolution);
+
+	shader.setInt("clipmapLevels", Storage == ClipmapStorage ? ClipmapLevels : 0);
+	if (Storage == ClipmapStorage)
+		shader.setVec3Array("clipMin", FrontClipMin.data(), ClipmapLevels);
+
+	SetConeSettings(shader, cones);
 
-	coneShader.setMat4("view", glm::value_ptr(view));
-	coneShader.setMat4("projection", glm::value_ptr(projection));
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, ourRSM->RSM_PositionDepth);
+	shader.setInt("gPositionDepth", 1);
+	glActiveTexture(GL_TEXTURE20);
+	glBindTexture(GL_TEXTURE_3D, OpacityTex);
+	shader.setInt("opacity", 20);
+	shader.setBool("coneShadows", ConeShadows);
+
+	//deferred inputs, bound by DrawDeferred; units of their own since a 2D sampler may not share one with a 3D sampler
+	shader.setInt("gPosition", 12);
+	shader.setInt("gNormal", 13);
+	shader.setInt("gAlbedo", 14);
+	shader.setInt("gSpecular", 15);
+	shader.setInt("indirect", 16);
+}
 
+//voxelAO.frag's subset of SetConeTracingUniforms, aoShader must be in use
+void DirVXGI::SetAmbientOcclusionUniforms()
+{
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_3D, Tex);
-	coneShader.setInt("tex", 0);
-	coneShader.setInt("Step", Step);
-	coneShader.setVec3("minPos", min);
-	coneShader.setVec3("maxPos", max);
+	glBindTexture(GL_TEXTURE_3D, OpacityTex);
+	aoShader.setInt("opacity", 0);
 
-	coneShader.setVec3("viewPos", viewPos);
+	SetConeSettings(aoShader, aoCones);
 
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, ourRSM->RSM_PositionDepth);
-	coneShader.setInt("gPositionDepth", 1);
+	aoShader.setInt("gPositionDepth", 1);
+	aoShader.setBool("coneShadows", ConeShadows);
+}
 
-	LightInfo info;
-	ourRSM->light.GetLightInfo(info);
-	coneShader.setVec3("dirlight.ambient", info.Ambient);
-	coneShader.setVec3("dirlight.diffuse", info.Diffuse);
-	coneShader.setVec3("dirlight.specular", info.Specular);
-	coneShader.setVec3("dirlight.direction", info.Direction);
+void DirVXGI::SetConeSettings(const Shader& shader, const ConeUniforms& uniforms)
+{
+	shader.setFloat(uniforms.stepValue, Cones.StepValue);
+	shader.setFloat(uniforms.lambda, Cones.Lambda);
+	shader.setFloat(uniforms.maxDistance, Cones.MaxDistance);
+	shader.setFloat(uniforms.diffuseTan, glm::tan(glm::radians(Cones.DiffuseAperture)));
+	shader.setInt(uniforms.diffuseConeCount, glm::clamp(Cones.DiffuseCones, 1u, 6u));
+	shader.setFloat(uniforms.shadowTan, glm::tan(glm::radians(Cones.ShadowAperture)));
+	shader.setFloat(uniforms.shadowStep, Cones.ShadowStep);
+}
+
+//the std140 blocks every shading pass of the frame reads, each uploads only what changed since the last frame.
+//The LightBlock was written by Voxelization
+void DirVXGI::UpdateFrameBlocks(const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection)
+{
+	FrameBlock frame{};
+	frame.View = view;
+	frame.Projection = projection;
+	frame.ViewPos = viewPos;
+	frameBlock.Update(&frame);
 
-	coneShader.setMat4("lightSpaceMatrix", glm::value_ptr(ourRSM->lightSpaceMatrix));
+	//the traced box is the front clipmap level's, the other levels come from clipMin
+	VolumeBlock volume{};
+	volume.MinPos = Storage == ClipmapStorage ? FrontClipMin[0] : min;
+	volume.MaxPos = volume.MinPos + (max - min);
+	volume.Step = Step;
+	volumeBlock.Update(&volume);
 
-	int numObjects = objects.size();
-	for (int i = 0; i != numObjects; i++)
+	ourRSM->UpdateLightBlock();
+}
+
+void DirVXGI::DrawDeferred(const unsigned int FBO, const vector<Object>& objects, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection)
+{
+	GpuScope passScope(ourProfiler, "gbuffer");
+
+	glBindFramebuffer(GL_FRAMEBUFFER, GBufferFBO);
+	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+	glFrontFace(GL_CCW);
+	glDisable(GL_STENCIL_TEST);
+	glDisable(GL_BLEND);
+
+	gbufferShader.use();
+	gbufferShader.setBool("fullscreen", false);
+	gbufferShader.setInt(gbufferObject.diffuse, 2);
+	gbufferShader.setInt(gbufferObject.specular, 3);
+	for (const Object& object : objects)
 	{
-		coneShader.setMat4("model", glm::value_ptr(objects[i].model));
-		coneShader.setFloat("material.roughness", objects[i].Roughness);
-		coneShader.setFloat("material.shininess", objects[i].Shininess);
+		gbufferShader.setMat4(gbufferObject.model, glm::value_ptr(object.model));
+		gbufferShader.setFloat(gbufferObject.roughness, object.Roughness);
+		gbufferShader.setFloat(gbufferObject.shininess, object.Shininess);
 		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, objects[i].texture_diffuse);
-		coneShader.setInt("material.diffuse", 2);
+		glBindTexture(GL_TEXTURE_2D, object.texture_diffuse);
 		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, objects[i].texture_specular);
-		coneShader.setInt("material.specular", 3);
+		glBindTexture(GL_TEXTURE_2D, object.texture_specular);
 
-		glBindVertexArray(objects[i].VAO);
-		glDrawElements(GL_TRIANGLES, objects[i].Count, GL_UNSIGNED_INT, 0);
+		glBindVertexArray(object.VAO);
+		glDrawElements(GL_TRIANGLES, object.Count, GL_UNSIGNED_INT, 0);
+	}
+
+	passScope.Next("indirect_diffuse");
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+
+	unsigned int targets[5] = { GPosition, GNormal, GAlbedo, GSpecular, IndirectTex };
+	for (int i = 0; i != 5; i++)
+	{
+		glActiveTexture(GL_TEXTURE12 + i);
+		glBindTexture(GL_TEXTURE_2D, targets[i]);
+	}
+
+	glBindVertexArray(emptyVAO);
+	//with probes the composite reads them per pixel instead
+	if (!Probes)
+	{
+		coneDiffuseShader.use();
+		SetConeTracingUniforms(coneDiffuseShader, coneDiffuseCones);
+		coneDiffuseShader.setBool("fullscreen", true);
+		coneDiffuseShader.setInt("scale", DeferredScale);
+		coneDiffuseShader.setInt("conesPerFrame", Temporal ? ConesPerFrame : 0);
+		coneDiffuseShader.setInt("frameIndex", temporalFrame);
+		coneDiffuseShader.setFloat("jitter", glm::fract(temporalFrame * 0.618034f));
+		glBindFramebuffer(GL_FRAMEBUFFER, IndirectFBO);
+		glViewport(0, 0, (SCR_WIDTH + DeferredScale - 1) / DeferredScale, (SCR_HEIGHT + DeferredScale - 1) / DeferredScale);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	if (Temporal && !Probes)
+	{
+		passScope.Next("temporal");
+		unsigned int last = historyIndex;
+		historyIndex ^= 1;
+
+		temporalShader.use();
+		temporalShader.setBool("fullscreen", true);
+		temporalShader.setInt("scale", DeferredScale);
+		temporalShader.setBool("historyValid", historyValid);
+		temporalShader.setInt("maxHistory", TemporalHistory);
+		temporalShader.setMat4("prevViewProjection", glm::value_ptr(prevViewProjection));
+		temporalShader.setVec3("prevViewPos", prevViewPos);
+		//the G-buffer and this frame's cones are still on 12, 13 and 16, the composite's shadow map stays on 1
+		glActiveTexture(GL_TEXTURE17);
+		glBindTexture(GL_TEXTURE_2D, HistoryTex[last]);
+		glActiveTexture(GL_TEXTURE18);
+		glBindTexture(GL_TEXTURE_2D, HistoryGuide[last]);
+		glActiveTexture(GL_TEXTURE21);
+		glBindTexture(GL_TEXTURE_2D, HistoryCones[last]);
+		temporalShader.setInt("gPosition", 12);
+		temporalShader.setInt("gNormal", 13);
+		temporalShader.setInt("current", 16);
+		temporalShader.setInt("previous", 17);
+		temporalShader.setInt("previousGuide", 18);
+		temporalShader.setInt("previousCones", 21);
+		glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[historyIndex]);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		//the composite upsamples the accumulated result instead of this frame's cones
+		glActiveTexture(GL_TEXTURE16);
+		glBindTexture(GL_TEXTURE_2D, HistoryTex[historyIndex]);
+		historyValid = true;
 	}
+	prevViewProjection = projection * view;
+	prevViewPos = viewPos;
+	temporalFrame++;
 
+	passScope.Next("composite");
+	//the target gets the scene depth for anything drawn after us, then the lit texels over its background
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, GBufferFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+	glBlitFramebuffer(0, 0, SCR_WIDTH, SCR_HEIGHT, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+	coneCompositeShader.use();
+	SetConeTracingUniforms(coneCompositeShader, coneCompositeCones);
+	coneCompositeShader.setBool("fullscreen", true);
+	coneCompositeShader.setInt("scale", DeferredScale);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glEnable(GL_DEPTH_TEST);
+	glBindVertexArray(0);
 }
 
 #endif
@@ -0,0 +1,555 @@
+//Headless benchmark: renders the VXGI scene of main.cpp into an offscreen
+//framebuffer through an EGL surfaceless context (Mesa llvmpipe is enough)
+//and prints per-phase timings. Linux only, see CMakeLists.txt.
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "shader.h"
+#include "image.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "camera.h"
+#include "object.h"
+#include "GI3D/RSM.h"
+#include "GI3D/VXGI.h"
+#include "GI3D/Governor.h"
+#include "scene.h"
+#include "profiler.h"
+
+#ifndef VXGI_BENCH_WIDTH
+#define VXGI_BENCH_WIDTH 800
+#endif
+#ifndef VXGI_BENCH_HEIGHT
+#define VXGI_BENCH_HEIGHT 600
+#endif
+#ifndef VXGI_RESOURCE_DIR
+#define VXGI_RESOURCE_DIR "."
+#endif
+
+extern const unsigned int SCR_WIDTH = VXGI_BENCH_WIDTH;
+extern const unsigned int SCR_HEIGHT = VXGI_BENCH_HEIGHT;
+
+//camera
+Camera camera(glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+struct BenchOptions
+{
+	int frames = 100;
+	int warmup = 5;
+	float timestep = 1.0f / 60.0f;
+	unsigned int step = 128;
+	std::string root = VXGI_RESOURCE_DIR;
+	bool perFrame = false;
+	std::string profile;
+	VoxelizationMode voxelizer = RasterVoxelization;
+	VoxelStorage storage = DenseStorage;
+	unsigned int clipmapLevels = 4;
+	bool anisotropic = false;
+	bool computeMipmaps = false;
+	bool fixedPoint = false;
+	bool lightInjection = false;
+	bool dirtyRegions = false;
+	bool multiBounce = false;
+	bool animate = false;
+	unsigned int rsmInterval = 1;
+	unsigned int slices = 1;
+	//mip of the voxel view drawn instead of cone tracing, -1 for cone tracing
+	int drawVoxels = -1;
+	bool occupancy = false;
+	//diffuse cone resolution divisor of the deferred path, 0 for forward cone tracing
+	unsigned int deferredScale = 0;
+	//diffuse cones per frame with temporal accumulation, 0 for all six every frame
+	unsigned int temporalCones = 0;
+	//GPU time the quality governor holds voxelization + cone tracing to, 0 for fixed quality
+	float targetMs = 0.0f;
+	//irradiance probes per axis replacing the diffuse cones, 0 for cones
+	unsigned int probes = 0;
+	//occlusion-only cones against an R8 opacity volume instead of full cone tracing
+	bool voxelAO = false;
+	//direct light shadowed by a cone through the opacity volume, the RSM is not drawn
+	bool coneShadows = false;
+	//depth-only pass before forward cone tracing
+	bool depthPrepass = false;
+};
+
+enum BenchPhase
+{
+	PHASE_VOXELIZATION = 0, PHASE_CONE_TRACING, PHASE_RESOLVE, PHASE_COUNT
+};
+const char* phaseNames[PHASE_COUNT] = { "voxelization", "cone_tracing", "resolve" };
+const char* storageNames[] = { "dense", "octree", "clipmap" };
+
+bool ParseOptions(int argc, char** argv, BenchOptions& options);
+bool CreateHeadlessContext(EGLDisplay& display, EGLContext& context);
+double ElapsedMs(std::chrono::steady_clock::time_point& last);
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	if (!ParseOptions(argc, argv, options))
+		return -1;
+	if (chdir(options.root.c_str()) != 0)
+	{
+		std::cout << "Failed to enter resource directory " << options.root << std::endl;
+		return -1;
+	}
+
+	//EGL
+	EGLDisplay display;
+	EGLContext context;
+	if (!CreateHeadlessContext(display, context))
+		return -1;
+
+	//GLAD
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+	std::cout << "renderer: " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << std::endl;
+
+	//program
+	Shader frameShader("res/shader/hdr.vert", "res/shader/hdr.frag");
+
+	//HDR framebuffer
+	unsigned int FBO;
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+	unsigned int texColorBuffer;
+	glGenTextures(1, &texColorBuffer);
+	glBindTexture(GL_TEXTURE_2D, texColorBuffer);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texColorBuffer, 0);
+
+	unsigned int RBO;
+	glGenRenderbuffers(1, &RBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, RBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RBO);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+	}
+
+	//LDR target standing in for the window's default framebuffer
+	unsigned int resolveFBO;
+	glGenFramebuffers(1, &resolveFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, resolveFBO);
+
+	unsigned int resolveColorBuffer;
+	glGenTextures(1, &resolveColorBuffer);
+	glBindTexture(GL_TEXTURE_2D, resolveColorBuffer);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolveColorBuffer, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	float frameVertices[] =
+	{
+		-1.0, -1.0,  0.0, 0.0,
+		 1.0, -1.0,  1.0, 0.0,
+		 1.0,  1.0,  1.0, 1.0,
+		 1.0,  1.0,  1.0, 1.0,
+		-1.0,  1.0,  0.0, 1.0,
+		-1.0, -1.0,  0.0, 0.0
+	};
+
+	unsigned int frameVBO;
+	glGenBuffers(1, &frameVBO);
+	unsigned int frameVAO;
+	glGenVertexArrays(1, &frameVAO);
+
+	glBindVertexArray(frameVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, frameVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(frameVertices), frameVertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+
+	//scene
+	DirScene ourDirScene;
+	LoadDirScene(ourDirScene);
+	DirRSM ourDriRSM(ourDirScene.light, ourDirScene.lightPosition);
+	ourDriRSM.SetTwoPass();
+
+	vector<Object>& ourDirObjects = ourDirScene.objects;
+
+	glm::vec3 min(-12.0);
+	glm::vec3 max(12.0);
+	DirVXGI ourDirVXGI(options.step, &ourDriRSM, min, max, options.storage, options.clipmapLevels);
+	ourDirVXGI.SetVoxelizationMode(options.voxelizer);
+	ourDirVXGI.SetAnisotropic(options.anisotropic);
+	ourDirVXGI.SetComputeMipmaps(options.computeMipmaps);
+	ourDirVXGI.SetFixedPointAccumulation(options.fixedPoint);
+	ourDirVXGI.SetLightInjection(options.lightInjection);
+	ourDirVXGI.SetDirtyRegions(options.dirtyRegions);
+	ourDirVXGI.SetMultiBounce(options.multiBounce);
+	ourDirVXGI.SetSchedule(options.rsmInterval, options.slices);
+	ourDirVXGI.SetOccupancy(options.occupancy);
+	ourDirVXGI.SetDeferred(options.deferredScale != 0, std::max(options.deferredScale, 1u));
+	if (options.temporalCones != 0)
+		ourDirVXGI.SetTemporal(true, options.temporalCones);
+	if (options.probes != 0)
+		ourDirVXGI.SetProbes(true, options.probes);
+	if (options.voxelAO)
+		ourDirVXGI.SetAmbientOcclusion(true);
+	if (options.coneShadows)
+		ourDirVXGI.SetConeShadows(true);
+	ourDirVXGI.SetDepthPrepass(options.depthPrepass);
+
+	//GPU pass timings, only recorded for measured frames
+	GpuProfiler ourProfiler;
+	if (!options.profile.empty())
+		ourDirVXGI.SetProfiler(&ourProfiler);
+
+	QualityGovernor ourGovernor(&ourDirVXGI, options.targetMs);
+	bool governed = options.targetMs > 0.0f;
+
+	//same initial view as the viewer after its first mouse event
+	camera.ViewMove(0.0, 0.0);
+
+	std::cout << "frames: " << options.frames << " (+" << options.warmup << " warmup), timestep: " << options.timestep
+		<< " s, Step: " << options.step
+		<< ", voxelizer: " << (options.voxelizer == ComputeVoxelization ? "compute" : "raster")
+		<< ", accumulation: " << (options.fixedPoint ? "fixed" : "cas")
+		<< ", lighting: " << (options.lightInjection ? "rsm injection" : "voxelized") << (options.multiBounce ? " + bounces" : "")
+		<< ", update: " << (options.dirtyRegions ? "dirty regions" : "full") << (options.animate ? " (animated)" : "")
+		<< ", view: " << (options.drawVoxels >= 0 ? "voxels mip " + std::to_string(options.drawVoxels) : std::string("cone tracing")) << (options.occupancy ? " (occupancy skipping)" : "")
+		<< (options.deferredScale != 0 ? " (deferred, diffuse at 1/" + std::to_string(options.deferredScale) + ")" : std::string())
+		<< (options.temporalCones != 0 ? " (temporal, " + std::to_string(options.temporalCones) + " cones per frame)" : std::string())
+		<< (options.probes != 0 ? " (" + std::to_string(options.probes) + "^3 probes)" : std::string())
+		<< (options.voxelAO ? " (voxel ambient occlusion)" : "")
+		<< (options.coneShadows ? " (cone-traced shadows)" : "")
+		<< (options.depthPrepass ? " (depth pre-pass)" : "")
+		<< ", schedule: rsm every " << options.rsmInterval << ", " << options.slices << " slices"
+		<< ", storage: " << storageNames[options.storage] << (options.anisotropic ? " (anisotropic mips)" : options.computeMipmaps ? " (compute mips)" : "") << ", resolution: " << SCR_WIDTH << "x" << SCR_HEIGHT << std::endl;
+
+	std::vector<double> timings[PHASE_COUNT];
+	std::vector<double> frameTimings;
+	Cube ourVoxCube("res/texture/gold.png", "res/texture/gold.png");
+
+	int totalFrames = options.warmup + options.frames;
+	for (int frame = 0; frame != totalFrames; frame++)
+	{
+		//fixed timestep: slow strafe so view dependent work changes deterministically
+		camera.PositionMove(frame % 240 < 120 ? RIGHT : LEFT, options.timestep * 0.1);
+		//dynamic objects circle around where the scene put them
+		for (unsigned int i = 0; options.animate && i != ourDirObjects.size(); i++)
+		{
+			if (ourDirObjects[i].Static)
+				continue;
+			float angle = frame * options.timestep;
+			glm::vec3 offset = (glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) - glm::vec3(std::cos(angle - options.timestep), 0.0f, std::sin(angle - options.timestep))) * 2.0f;
+			ourDirObjects[i].model = glm::translate(glm::mat4(1.0f), offset) * ourDirObjects[i].model;
+		}
+
+		glFinish();
+		auto last = std::chrono::steady_clock::now();
+		double phase[PHASE_COUNT];
+		bool profiled = !options.profile.empty() && frame >= options.warmup;
+		if (profiled)
+			ourProfiler.BeginFrame();
+
+		//framebuffer
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glEnable(GL_DEPTH_TEST);
+
+		glDisable(GL_CULL_FACE);
+		glCullFace(GL_FRONT);
+		glFrontFace(GL_CCW);
+
+		glDisable(GL_STENCIL_TEST);
+
+		glDisable(GL_BLEND);
+		glBlendEquation(GL_FUNC_ADD);
+		glBlendFunc(GL_ONE, GL_ONE);
+
+		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+
+		//voxel
+		if (governed)
+			ourGovernor.Begin(GovernorVoxelization);
+		ourDirVXGI.Voxelization(ourDirObjects, camera.Position);
+		if (governed)
+			ourGovernor.End();
+		glFinish();
+		phase[PHASE_VOXELIZATION] = ElapsedMs(last);
+
+		//view projection
+		glm::mat4 view = camera.ViewMatrix();
+		glm::mat4 projection = glm::perspective(glm::radians(camera.Fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+
+		//draw
+		if (governed)
+			ourGovernor.Begin(GovernorConeTracing);
+		if (options.drawVoxels >= 0)
+			ourDirVXGI.DrawVoxel(FBO, ourVoxCube, options.drawVoxels, view, projection);
+		else
+			ourDirVXGI.DrawObject(FBO, ourDirObjects, camera.Position, view, projection);
+		if (governed)
+		{
+			ourGovernor.End();
+			ourGovernor.Update();
+		}
+		glFinish();
+		phase[PHASE_CONE_TRACING] = ElapsedMs(last);
+
+		//resolve
+		glBindFramebuffer(GL_FRAMEBUFFER, resolveFBO);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_STENCIL_TEST);
+		glDisable(GL_BLEND);
+		glClearColor(0.0f, 0.0f, 0.1f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+
+		frameShader.use();
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texColorBuffer);
+		frameShader.setInt("texColorBuffer", 0);
+
+		frameShader.setFloat("exposure", 1.0f);
+		glBindVertexArray(frameVAO);
+		{
+			GpuScope scope(profiled ? &ourProfiler : nullptr, "resolve");
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		}
+		if (profiled)
+			ourProfiler.EndFrame();
+		glFinish();
+		phase[PHASE_RESOLVE] = ElapsedMs(last);
+
+		if (frame < options.warmup)
+			continue;
+
+		double total = 0.0;
+		for (int i = 0; i != PHASE_COUNT; i++)
+		{
+			timings[i].push_back(phase[i]);
+			total += phase[i];
+		}
+		frameTimings.push_back(total);
+
+		if (options.perFrame)
+		{
+			std::cout << "frame " << frame - options.warmup;
+			for (int i = 0; i != PHASE_COUNT; i++)
+				std::cout << " " << phaseNames[i] << "=" << phase[i];
+			std::cout << " total=" << total;
+			if (governed)
+				std::cout << " quality=" << ourGovernor.Quality << " gpu=" << ourGovernor.FrameMs;
+			std::cout << std::endl;
+		}
+	}
+
+	//summary
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::left << std::setw(16) << "phase (ms)" << std::right << std::setw(10) << "mean"
+		<< std::setw(10) << "median" << std::setw(10) << "min" << std::setw(10) << "max" << std::endl;
+	for (int i = 0; i <= PHASE_COUNT; i++)
+	{
+		const std::vector<double>& source = i == PHASE_COUNT ? frameTimings : timings[i];
+		if (source.empty())
+			continue;
+		//sorted copy for the median
+		std::vector<double> samples(source.begin(), source.end());
+		std::sort(samples.begin(), samples.end());
+		size_t n = samples.size();
+		double median = n % 2 == 0 ? 0.5 * (samples[n / 2 - 1] + samples[n / 2]) : samples[n / 2];
+		double sum = 0.0;
+		for (double s : samples)
+			sum += s;
+		std::cout << std::left << std::setw(16) << (i == PHASE_COUNT ? "frame" : phaseNames[i]) << std::right
+			<< std::setw(10) << sum / n
+			<< std::setw(10) << median
+			<< std::setw(10) << samples.front()
+			<< std::setw(10) << samples.back() << std::endl;
+	}
+
+	if (options.storage == OctreeStorage)
+		std::cout << "octree nodes: " << ourDirVXGI.OctreeNodeCount() << std::endl;
+	if (governed)
+		std::cout << "governor: quality " << ourGovernor.Quality << " after " << ourGovernor.Changes << " changes, gpu " << ourGovernor.FrameMs
+			<< " ms, step " << ourDirVXGI.Cones.StepValue << ", aperture " << ourDirVXGI.Cones.DiffuseAperture
+			<< ", diffuse cones " << ourDirVXGI.Cones.DiffuseCones << ", rsm " << ourDirVXGI.ourRSM->Resolution() << std::endl;
+
+	if (!options.profile.empty())
+	{
+		ourProfiler.Flush();
+		if (ourProfiler.Write(options.profile))
+			std::cout << "GPU pass timings written to " << options.profile << std::endl;
+	}
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglTerminate(display);
+	return 0;
+}
+
+bool ParseOptions(int argc, char** argv, BenchOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--frames" && hasValue)
+			options.frames = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--warmup" && hasValue)
+			options.warmup = std::max(0, std::atoi(argv[++i]));
+		else if (arg == "--dt" && hasValue)
+			options.timestep = (float)std::atof(argv[++i]);
+		else if (arg == "--step" && hasValue)
+			options.step = (unsigned int)std::max(4, std::atoi(argv[++i]));
+		else if (arg == "--root" && hasValue)
+			options.root = argv[++i];
+		else if (arg == "--voxelizer" && hasValue)
+			options.voxelizer = std::string(argv[++i]) == "compute" ? ComputeVoxelization : RasterVoxelization;
+		else if (arg == "--storage" && hasValue)
+		{
+			std::string storage = argv[++i];
+			options.storage = storage == "octree" ? OctreeStorage : storage == "clipmap" ? ClipmapStorage : DenseStorage;
+		}
+		else if (arg == "--clip-levels" && hasValue)
+			options.clipmapLevels = (unsigned int)std::min(8, std::max(1, std::atoi(argv[++i])));
+		else if (arg == "--profile" && hasValue)
+			options.profile = argv[++i];
+		else if (arg == "--mips" && hasValue)
+			options.computeMipmaps = std::string(argv[++i]) == "compute";
+		else if (arg == "--accumulate" && hasValue)
+			options.fixedPoint = std::string(argv[++i]) == "fixed";
+		else if (arg == "--bounce")
+			options.multiBounce = options.lightInjection = true;
+		else if (arg == "--dirty-regions")
+			options.dirtyRegions = true;
+		else if (arg == "--rsm-interval" && hasValue)
+			options.rsmInterval = (unsigned int)std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--slices" && hasValue)
+			options.slices = (unsigned int)std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--draw-voxels" && hasValue)
+			options.drawVoxels = std::max(0, std::atoi(argv[++i]));
+		else if (arg == "--occupancy")
+			options.occupancy = true;
+		else if (arg == "--deferred" && hasValue)
+			options.deferredScale = (unsigned int)std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--probes" && hasValue)
+			options.probes = (unsigned int)std::min(64, std::max(2, std::atoi(argv[++i])));
+		else if (arg == "--voxel-ao")
+			options.voxelAO = true;
+		else if (arg == "--cone-shadows")
+			options.coneShadows = true;
+		else if (arg == "--depth-prepass")
+			options.depthPrepass = true;
+		else if (arg == "--target-ms" && hasValue)
+			options.targetMs = (float)std::max(0.0, std::atof(argv[++i]));
+		else if (arg == "--temporal" && hasValue)
+		{
+			//accumulates the deferred path's diffuse cones, half resolution unless --deferred says otherwise
+			options.temporalCones = (unsigned int)std::min(6, std::max(1, std::atoi(argv[++i])));
+			if (options.deferredScale == 0)
+				options.deferredScale = 2;
+		}
+		else if (arg == "--animate")
+			options.animate = true;
+		else if (arg == "--light-injection")
+			options.lightInjection = true;
+		else if (arg == "--anisotropic")
+			options.anisotropic = true;
+		else if (arg == "--per-frame")
+			options.perFrame = true;
+		else
+		{
+			std::cout << "usage: " << argv[0]
+				<< " [--frames N] [--warmup N] [--dt seconds] [--step N] [--voxelizer raster|compute] [--storage dense|octree|clipmap] [--clip-levels N] [--anisotropic] [--mips driver|compute] [--accumulate cas|fixed] [--light-injection] [--bounce] [--dirty-regions] [--animate] [--rsm-interval N] [--slices N] [--draw-voxels mip] [--occupancy] [--deferred scale] [--temporal cones] [--target-ms ms] [--probes N] [--voxel-ao] [--cone-shadows] [--depth-prepass] [--root resource_dir] [--profile out.csv|out.json] [--per-frame]" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CreateHeadlessContext(EGLDisplay& display, EGLContext& context)
+{
+	//prefer the surfaceless platform, no X11/Wayland/DRM device needed
+	display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (eglGetPlatformDisplayEXT)
+		display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+	{
+		std::cout << "Failed to initialize EGL display" << std::endl;
+		return false;
+	}
+
+	EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "Failed to bind the OpenGL API" << std::endl;
+		return false;
+	}
+
+	EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT)
+	{
+		std::cout << "Failed to create an OpenGL 4.5 core context (EGL error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+		return false;
+	}
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		std::cout << "Failed to make the EGL context current" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+double ElapsedMs(std::chrono::steady_clock::time_point& last)
+{
+	auto now = std::chrono::steady_clock::now();
+	double ms = std::chrono::duration<double, std::milli>(now - last).count();
+	last = now;
+	return ms;
+}
@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cmath>
 #include "object.h"
 
 enum LightType
@@ -91,7 +92,7 @@ private:
 	float GetSphereRadius() {
 		float lightMax = std::fmaxf(std::fmaxf(Diffuse.r, Diffuse.g), Diffuse.b);
 		float radius =
-			(-Linear + std::sqrtf(Linear * Linear - 4 * Quadratic * (Constant - (256.0 / 5.0) * lightMax)))
+			(-Linear + std::sqrt(Linear * Linear - 4 * Quadratic * (Constant - (256.0 / 5.0) * lightMax)))
 			/ (2 * Quadratic);
 		return radius;
 	}
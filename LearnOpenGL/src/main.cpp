@@ -14,6 +14,7 @@
 #include "fps.h"
 #include "GI3D/RSM.h" 
 #include "GI3D/VXGI.h"
+#include "scene.h"
 using std::map;
 
 void processInput(GLFWwindow* window);
@@ -201,41 +202,18 @@ int main() {
 	glEnableVertexAttribArray(1);
 
 	//rsm
-	glm::vec3 ourDirPosition = glm::vec3(10.0f, 10.0f, 10.0f);
-	glm::vec3 ourDirDirection = glm::vec3(-10.0f, -7.0f, -10.0f);
-	glm::vec3 ourDirAmbient = glm::vec3(0.05f, 0.05f, 0.05f);
-	glm::vec3 ourDirDiffuse = glm::vec3(10.0f, 10.0f, 10.0f);
-	glm::vec3 ourDirSpecular = glm::vec3(0.4f, 0.4f, 0.4f);
-
-	DirLight ourDirLight(ourDirDirection, ourDirAmbient, ourDirDiffuse, ourDirSpecular);
-	DirRSM ourDriRSM(ourDirLight, ourDirPosition);
+	DirScene ourDirScene;
+	LoadDirScene(ourDirScene);
+	DirRSM ourDriRSM(ourDirScene.light, ourDirScene.lightPosition);
 	ourDriRSM.SetTwoPass();
 
-	const char* ourDirCubeTex = "res/texture/gold.png";
-	const char* ourDirSquareTex = "res/texture/brick.jpg";
-	Cube ourDirCube(ourDirCubeTex, ourDirCubeTex,true,0.6);
-	ourDirCube.SetModel(glm::vec3(2.5, 1.7, 7.0), 3.0);
-	Cube ourDirFloor(ourDirSquareTex, ourDirSquareTex,true,0.6);
-	ourDirFloor.SetModel(glm::vec3(5.0, 0.0, 5.0), glm::vec3(10.0,0.1,10.0));
-	Cube ourDirWall1(ourDirSquareTex, ourDirSquareTex,true,0.6);
-	ourDirWall1.SetModel(glm::vec3(5.0, 3.0, 0.0), glm::vec3(10.0, 6.0, 0.1));
-	Cube ourDirWall2(ourDirSquareTex, ourDirSquareTex,true,0.6);
-	ourDirWall2.SetModel(glm::vec3(0.0, 3.0, 5.0), glm::vec3(0.1, 6.0, 10.0));
-	Sphere ourDirSphere(ourDirCubeTex, ourDirCubeTex,0.8);
-	ourDirSphere.SetModel(glm::vec3(7.0, 3.2, 4.0), 3.0);
-
-	vector<Object>ourDirObjects;
-	ourDirObjects.push_back(ourDirCube);
-	ourDirObjects.push_back(ourDirFloor);
-	ourDirObjects.push_back(ourDirWall1);
-	ourDirObjects.push_back(ourDirWall2);
-	ourDirObjects.push_back(ourDirSphere);
+	vector<Object>& ourDirObjects = ourDirScene.objects;
 
 	//Font
 	Font ourFont;
 
 	//Voxel
-	Cube ourVoxCube(ourDirCubeTex, ourDirCubeTex);
+	Cube ourVoxCube("res/texture/gold.png", "res/texture/gold.png");
 
 	glm::vec3 min(-12.0);
 	glm::vec3 max(12.0);
@@ -11,6 +11,7 @@
 #include <glm/gtc/type_ptr.hpp>
 #include<string>
 #include<vector>
+#include<cfloat>
 
 using std::string;
 using std::vector;
@@ -60,6 +61,10 @@ public:
 	pbrMaps PBR;
 	float Shininess=32;
 	float Roughness = 0.5;
+	//never moves, voxelized once into the static layer of DirVXGI
+	bool Static = false;
+	//local space bounding box, the primitives are unit sized
+	glm::vec3 BoundsMin = glm::vec3(-0.5f), BoundsMax = glm::vec3(0.5f);
 	unsigned int Count;
 	virtual void GetVertexArray(unsigned int n, bool out) {}
 	virtual void GetTextures(const char* diffuse, const char* specular) {}
@@ -78,8 +83,22 @@ public:
 		model = glm::rotate(model, glm::radians(_angle), _axis);
 	}
 	void SetPBR(const char* albedo, const char* normal, const char* metalness, const char* ao, const char* roughness);
+	void GetWorldBounds(glm::vec3& worldMin, glm::vec3& worldMax) const;
 };
 
+void Object::GetWorldBounds(glm::vec3& worldMin, glm::vec3& worldMax) const
+{
+	worldMin = glm::vec3(FLT_MAX);
+	worldMax = glm::vec3(-FLT_MAX);
+	for (int i = 0; i != 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? BoundsMax.x : BoundsMin.x, (i & 2) ? BoundsMax.y : BoundsMin.y, (i & 4) ? BoundsMax.z : BoundsMin.z);
+		glm::vec3 p = glm::vec3(model * glm::vec4(corner, 1.0f));
+		worldMin = glm::min(worldMin, p);
+		worldMax = glm::max(worldMax, p);
+	}
+}
+
 void Object::SetPBR(const char* albedo, const char* normal, const char* metalness, const char* ao, const char* roughness)
 {
 	//albedo
@@ -258,6 +277,8 @@ Sphere::Sphere(const char* diffuse, const char* specular, float roughness, float
 	GetTextures(diffuse, specular);
 	Shininess = shininess;
 	Roughness = roughness;
+	BoundsMin = glm::vec3(-1.0f);
+	BoundsMax = glm::vec3(1.0f);
 }
 
 void Sphere::GetVertexArray(unsigned int n, bool out)
@@ -0,0 +1,256 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+//GPU timings of one pass in one frame
+struct GpuPassTiming
+{
+	unsigned int frame;
+	string name;
+	int depth;
+	double start;
+	double ms;
+};
+
+//Per-pass GPU profiler built on GL_TIMESTAMP queries.
+//Results are read back FRAMES_IN_FLIGHT frames later, so the CPU never waits on the GPU.
+class GpuProfiler
+{
+public:
+	static const unsigned int FRAMES_IN_FLIGHT = 4;
+
+	GpuProfiler() = default;
+	~GpuProfiler();
+
+	void BeginFrame();
+	void EndFrame();
+	void Begin(const string& name);
+	void End();
+	void Flush();
+	bool Write(const string& path) const;
+
+	vector<GpuPassTiming> Timings;
+	unsigned int DroppedFrames = 0;
+
+private:
+	struct Scope
+	{
+		string name;
+		int depth;
+		unsigned int begin, end;
+	};
+	struct FrameSlot
+	{
+		unsigned int frame = 0;
+		bool pending = false;
+		vector<Scope> scopes;
+		vector<unsigned int> queries;
+		unsigned int used = 0;
+	};
+
+	unsigned int GetQuery(FrameSlot& slot);
+	bool Resolve(FrameSlot& slot, bool wait);
+	bool WriteCSV(std::ofstream& file) const;
+	bool WriteJSON(std::ofstream& file) const;
+
+	FrameSlot slots[FRAMES_IN_FLIGHT];
+	vector<unsigned int> openScopes;
+	vector<string> names;
+	unsigned int frameCount = 0;
+	bool inFrame = false;
+};
+
+//Times the enclosing block, no-op without a profiler
+class GpuScope
+{
+public:
+	GpuScope(GpuProfiler* _profiler, const string& name)
+		:profiler(_profiler)
+	{
+		if (profiler)
+			profiler->Begin(name);
+	}
+	~GpuScope()
+	{
+		if (profiler)
+			profiler->End();
+	}
+	//closes the current scope and opens a sibling, for passes that run back to back
+	void Next(const string& name)
+	{
+		if (profiler)
+		{
+			profiler->End();
+			profiler->Begin(name);
+		}
+	}
+private:
+	GpuProfiler* profiler;
+};
+
+GpuProfiler::~GpuProfiler()
+{
+	for (FrameSlot& slot : slots)
+	{
+		if (!slot.queries.empty())
+			glDeleteQueries((GLsizei)slot.queries.size(), &slot.queries[0]);
+	}
+}
+
+void GpuProfiler::BeginFrame()
+{
+	FrameSlot& slot = slots[frameCount % FRAMES_IN_FLIGHT];
+	if (slot.pending && !Resolve(slot, false))
+		DroppedFrames++;
+
+	slot.frame = frameCount;
+	slot.pending = false;
+	slot.scopes.clear();
+	slot.used = 0;
+	openScopes.clear();
+	names.clear();
+	inFrame = true;
+}
+
+void GpuProfiler::EndFrame()
+{
+	while (!openScopes.empty())
+		End();
+
+	FrameSlot& slot = slots[frameCount % FRAMES_IN_FLIGHT];
+	slot.pending = !slot.scopes.empty();
+	inFrame = false;
+	frameCount++;
+}
+
+void GpuProfiler::Begin(const string& name)
+{
+	if (!inFrame)
+		return;
+	FrameSlot& slot = slots[frameCount % FRAMES_IN_FLIGHT];
+
+	string path = names.empty() ? name : names.back() + "/" + name;
+	Scope scope = { path, (int)openScopes.size(), GetQuery(slot), 0 };
+	glQueryCounter(scope.begin, GL_TIMESTAMP);
+
+	openScopes.push_back((unsigned int)slot.scopes.size());
+	names.push_back(path);
+	slot.scopes.push_back(scope);
+}
+
+void GpuProfiler::End()
+{
+	if (!inFrame || openScopes.empty())
+		return;
+	FrameSlot& slot = slots[frameCount % FRAMES_IN_FLIGHT];
+
+	Scope& scope = slot.scopes[openScopes.back()];
+	scope.end = GetQuery(slot);
+	glQueryCounter(scope.end, GL_TIMESTAMP);
+
+	openScopes.pop_back();
+	names.pop_back();
+}
+
+void GpuProfiler::Flush()
+{
+	//oldest first so rows stay ordered by frame
+	for (unsigned int i = 0; i != FRAMES_IN_FLIGHT; i++)
+	{
+		FrameSlot& slot = slots[(frameCount + i) % FRAMES_IN_FLIGHT];
+		if (slot.pending)
+			Resolve(slot, true);
+	}
+}
+
+unsigned int GpuProfiler::GetQuery(FrameSlot& slot)
+{
+	if (slot.used == slot.queries.size())
+	{
+		unsigned int query;
+		glGenQueries(1, &query);
+		slot.queries.push_back(query);
+	}
+	return slot.queries[slot.used++];
+}
+
+bool GpuProfiler::Resolve(FrameSlot& slot, bool wait)
+{
+	if (!wait)
+	{
+		//timestamps complete in order, the last one written covers the whole frame
+		GLuint available = 0;
+		glGetQueryObjectuiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+	}
+
+	GLuint64 frameStart = 0;
+	for (unsigned int i = 0; i != slot.scopes.size(); i++)
+	{
+		GLuint64 begin, end;
+		glGetQueryObjectui64v(slot.scopes[i].begin, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(slot.scopes[i].end, GL_QUERY_RESULT, &end);
+		if (i == 0)
+			frameStart = begin;
+
+		GpuPassTiming timing;
+		timing.frame = slot.frame;
+		timing.name = slot.scopes[i].name;
+		timing.depth = slot.scopes[i].depth;
+		timing.start = (double)(begin - frameStart) / 1.0e6;
+		timing.ms = (double)(end - begin) / 1.0e6;
+		Timings.push_back(timing);
+	}
+	slot.pending = false;
+	return true;
+}
+
+bool GpuProfiler::Write(const string& path) const
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cout << "ERROR::PROFILER::FILE_NOT_SUCCESFULLY_OPENED " << path << std::endl;
+		return false;
+	}
+	bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+	return json ? WriteJSON(file) : WriteCSV(file);
+}
+
+bool GpuProfiler::WriteCSV(std::ofstream& file) const
+{
+	file << "frame,pass,depth,start_ms,gpu_ms\n";
+	for (const GpuPassTiming& timing : Timings)
+	{
+		file << timing.frame << "," << timing.name << "," << timing.depth << ","
+			<< timing.start << "," << timing.ms << "\n";
+	}
+	return (bool)file;
+}
+
+bool GpuProfiler::WriteJSON(std::ofstream& file) const
+{
+	file << "{\n\t\"dropped_frames\": " << DroppedFrames << ",\n\t\"frames\": [";
+	for (unsigned int i = 0; i != Timings.size(); i++)
+	{
+		const GpuPassTiming& timing = Timings[i];
+		bool newFrame = i == 0 || Timings[i - 1].frame != timing.frame;
+		if (newFrame)
+			file << (i == 0 ? "" : "\n\t\t]},") << "\n\t\t{\"frame\": " << timing.frame << ", \"passes\": [";
+		file << (newFrame ? "" : ",") << "\n\t\t\t{\"name\": \"" << timing.name << "\", \"depth\": " << timing.depth
+			<< ", \"start_ms\": " << timing.start << ", \"gpu_ms\": " << timing.ms << "}";
+	}
+	file << (Timings.empty() ? "" : "\n\t\t]}") << "\n\t]\n}\n";
+	return (bool)file;
+}
+
+#endif
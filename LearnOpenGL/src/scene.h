@@ -0,0 +1,57 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "object.h"
+#include "light.h"
+
+using std::vector;
+
+//Scene shared by the viewer (main.cpp) and the headless benchmark (bench.cpp)
+struct DirScene
+{
+	glm::vec3 lightPosition;
+	DirLight light;
+	vector<Object> objects;
+};
+
+void LoadDirScene(DirScene& scene)
+{
+	//light
+	scene.lightPosition = glm::vec3(10.0f, 10.0f, 10.0f);
+	glm::vec3 ourDirDirection = glm::vec3(-10.0f, -7.0f, -10.0f);
+	glm::vec3 ourDirAmbient = glm::vec3(0.05f, 0.05f, 0.05f);
+	glm::vec3 ourDirDiffuse = glm::vec3(10.0f, 10.0f, 10.0f);
+	glm::vec3 ourDirSpecular = glm::vec3(0.4f, 0.4f, 0.4f);
+	scene.light = DirLight(ourDirDirection, ourDirAmbient, ourDirDiffuse, ourDirSpecular);
+
+	//objects
+	const char* ourDirCubeTex = "res/texture/gold.png";
+	const char* ourDirSquareTex = "res/texture/brick.jpg";
+	Cube ourDirCube(ourDirCubeTex, ourDirCubeTex, true, 0.6);
+	ourDirCube.SetModel(glm::vec3(2.5, 1.7, 7.0), 3.0);
+	Cube ourDirFloor(ourDirSquareTex, ourDirSquareTex, true, 0.6);
+	ourDirFloor.SetModel(glm::vec3(5.0, 0.0, 5.0), glm::vec3(10.0, 0.1, 10.0));
+	Cube ourDirWall1(ourDirSquareTex, ourDirSquareTex, true, 0.6);
+	ourDirWall1.SetModel(glm::vec3(5.0, 3.0, 0.0), glm::vec3(10.0, 6.0, 0.1));
+	Cube ourDirWall2(ourDirSquareTex, ourDirSquareTex, true, 0.6);
+	ourDirWall2.SetModel(glm::vec3(0.0, 3.0, 5.0), glm::vec3(0.1, 6.0, 10.0));
+	Sphere ourDirSphere(ourDirCubeTex, ourDirCubeTex, 0.8);
+	ourDirSphere.SetModel(glm::vec3(7.0, 3.2, 4.0), 3.0);
+
+	//only the cube is treated as movable
+	ourDirFloor.Static = true;
+	ourDirWall1.Static = true;
+	ourDirWall2.Static = true;
+	ourDirSphere.Static = true;
+
+	scene.objects.clear();
+	scene.objects.push_back(ourDirCube);
+	scene.objects.push_back(ourDirFloor);
+	scene.objects.push_back(ourDirWall1);
+	scene.objects.push_back(ourDirWall2);
+	scene.objects.push_back(ourDirSphere);
+}
+
+#endif
@@ -4,6 +4,8 @@
 #include <glad/glad.h> // gladȡеıOpenGLͷļ
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -18,10 +20,18 @@ public:
     // ID
     unsigned int ID;
 
+    //a uniform location resolved once with GetUniform, for setters called per object or per frame
+    struct Uniform
+    {
+        int location = -1;
+    };
+
     // ȡɫ
     Shader() = default;
-    Shader(const char* vertexPath, const char* fragmentPath);
+    //defines are "NAME" or "NAME VALUE", inserted as #define lines after the #version line of both stages
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {});
     Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath);
+    Shader(const char* computePath);
     // ʹ/
     void use();
     // uniformߺ
@@ -38,9 +48,31 @@ public:
     void setVec2(const std::string& name, const glm::vec2& vec2) const;
     void setMat4(const std::string& name, const float* transform) const;
     void setVec4(const std::string& name, glm::vec4 vec4) const;
+    //the whole array in one call, name is the array without a subscript
+    void setIntArray(const std::string& name, const int* values, int count) const;
+    void setVec2Array(const std::string& name, const glm::vec2* values, int count) const;
+    void setVec3Array(const std::string& name, const glm::vec3* values, int count) const;
+    void setMat4Array(const std::string& name, const glm::mat4* values, int count) const;
+
+    Uniform GetUniform(const std::string& name) const;
+    void setBool(Uniform uniform, bool value) const;
+    void setInt(Uniform uniform, int value) const;
+    void setFloat(Uniform uniform, float value) const;
+    void setVec3(Uniform uniform, const glm::vec3& vec3) const;
+    void setMat4(Uniform uniform, const float* transform) const;
+
+private:
+    //active uniforms by name, filled from the program interface after linking; arrays are listed bare and per element
+    std::unordered_map<std::string, int> uniforms;
+    void Reflect();
+    int Location(const std::string& name) const;
+    //expands the #include "file" lines of a source, file relative to the including source. Each included file is
+    //its own source string number in compile errors, sources counts them
+    static std::string Preprocess(const std::string& code, const std::string& path, int source, int& sources);
+    static std::string Define(const std::string& code, const std::vector<std::string>& defines);
 };
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines)
 {
     // 1. ļ·лȡ/Ƭɫ
     std::string vertexCode;
@@ -56,6 +88,7 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
         vShaderFile.open(vertexPath);
         fShaderFile.open(fragmentPath);
         std::stringstream vShaderStream, fShaderStream;
+        int includes = 0;
         // ȡļĻݵ
         vShaderStream << vShaderFile.rdbuf();
         fShaderStream << fShaderFile.rdbuf();
@@ -63,8 +96,8 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
         vShaderFile.close();
         fShaderFile.close();
         // תstring
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        vertexCode = Define(Preprocess(vShaderStream.str(), vertexPath, 0, includes), defines);
+        fragmentCode = Define(Preprocess(fShaderStream.str(), fragmentPath, 0, includes), defines);
     }
     catch (std::ifstream::failure e)
     {
@@ -114,6 +147,8 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
         glGetProgramInfoLog(ID, 512, NULL, infoLog);
         std::cout << vertexPath << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     }
+    else
+        Reflect();
 
     // ɾɫѾӵǵĳˣѾҪ
     glDeleteShader(vertex);
@@ -140,6 +175,7 @@ Shader::Shader(const char* vertexPath, const char* geometryPath, const char* fra
         gShaderFile.open(geometryPath);
         fShaderFile.open(fragmentPath);
         std::stringstream vShaderStream, gShaderStream, fShaderStream;
+        int includes = 0;
         // ȡļĻݵ
         vShaderStream << vShaderFile.rdbuf();
         gShaderStream << gShaderFile.rdbuf();
@@ -149,9 +185,9 @@ Shader::Shader(const char* vertexPath, const char* geometryPath, const char* fra
         gShaderFile.close();
         fShaderFile.close();
         // תstring
-        vertexCode = vShaderStream.str();
-        geometryCode = gShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        vertexCode = Preprocess(vShaderStream.str(), vertexPath, 0, includes);
+        geometryCode = Preprocess(gShaderStream.str(), geometryPath, 0, includes);
+        fragmentCode = Preprocess(fShaderStream.str(), fragmentPath, 0, includes);
     }
     catch (std::ifstream::failure e)
     {
@@ -215,6 +251,8 @@ Shader::Shader(const char* vertexPath, const char* geometryPath, const char* fra
         glGetProgramInfoLog(ID, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     }
+    else
+        Reflect();
 
     // ɾɫѾӵǵĳˣѾҪ
     glDeleteShader(vertex);
@@ -222,6 +260,111 @@ Shader::Shader(const char* vertexPath, const char* geometryPath, const char* fra
     glDeleteShader(fragment);
 }
 
+Shader::Shader(const char* computePath)
+{
+    std::string computeCode;
+    std::ifstream cShaderFile;
+    cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try
+    {
+        cShaderFile.open(computePath);
+        std::stringstream cShaderStream;
+        int includes = 0;
+        cShaderStream << cShaderFile.rdbuf();
+        cShaderFile.close();
+        computeCode = Preprocess(cShaderStream.str(), computePath, 0, includes);
+    }
+    catch (std::ifstream::failure e)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    }
+    const char* cShaderCode = computeCode.c_str();
+
+    unsigned int compute;
+    int success;
+    char infoLog[512];
+
+    // compute shader
+    compute = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(compute, 1, &cShaderCode, NULL);
+    glCompileShader(compute);
+    glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(compute, 512, NULL, infoLog);
+        std::cout << computePath << " ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+    };
+
+    ID = glCreateProgram();
+    glAttachShader(ID, compute);
+    glLinkProgram(ID);
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(ID, 512, NULL, infoLog);
+        std::cout << computePath << " ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+    else
+        Reflect();
+
+    glDeleteShader(compute);
+}
+
+std::string Shader::Preprocess(const std::string& code, const std::string& path, int source, int& sources)
+{
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    std::istringstream lines(code);
+    std::string line, result;
+    int number = 0;
+    while (std::getline(lines, line))
+    {
+        number++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+        {
+            result += line + "\n";
+            continue;
+        }
+        size_t open = line.find('"', start), close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos)
+        {
+            std::cout << path << ":" << number << " ERROR::SHADER::INCLUDE_NEEDS_A_QUOTED_FILE" << std::endl;
+            continue;
+        }
+        std::string file = directory + line.substr(open + 1, close - open - 1);
+        std::ifstream includeFile;
+        includeFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        includeFile.open(file);
+        std::stringstream includeStream;
+        includeStream << includeFile.rdbuf();
+        includeFile.close();
+
+        //#line N names the line that follows it
+        int included = ++sources;
+        result += "#line 1 " + std::to_string(included) + "\n";
+        result += Preprocess(includeStream.str(), file, included, sources);
+        result += "#line " + std::to_string(number + 1) + " " + std::to_string(source) + "\n";
+    }
+    return result;
+}
+
+std::string Shader::Define(const std::string& code, const std::vector<std::string>& defines)
+{
+    if (defines.empty())
+        return code;
+    //#version must stay the first line, the lines after it keep their numbers; Preprocess ends every line
+    size_t version = code.find("#version");
+    size_t end = version == std::string::npos ? 0 : code.find('\n', version) + 1;
+    int next = 1;
+    for (size_t i = 0; i != end; i++)
+        next += code[i] == '\n';
+    std::string result = code.substr(0, end);
+    for (const std::string& define : defines)
+        result += "#define " + define + "\n";
+    result += "#line " + std::to_string(next) + "\n";
+    return result + code.substr(end);
+}
+
 void Shader::use()
 {
     glUseProgram(ID);
@@ -229,57 +372,137 @@ void Shader::use()
 
 void Shader::setBool(const std::string& name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(Location(name), (int)value);
 }
 void Shader::setInt(const std::string& name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(Location(name), value);
 }
 void Shader::setuInt(const std::string& name, unsigned int value) const
 {
-    glUniform1ui(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1ui(Location(name), value);
 }
 void Shader::setFloat(const std::string& name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(Location(name), value);
 }
 void Shader::setVec4(const std::string& name, float v1, float v2, float v3, float v4) const
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), v1, v2, v3, v4);
+    glUniform4f(Location(name), v1, v2, v3, v4);
 }
 void Shader::setVec4(const std::string& name, glm::vec4 vec4) const
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), vec4.x,vec4.y,vec4.z,vec4.w);
+    glUniform4f(Location(name), vec4.x,vec4.y,vec4.z,vec4.w);
 }
 void Shader::setVec3(const std::string& name, float v1, float v2, float v3) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), v1, v2, v3);
+    glUniform3f(Location(name), v1, v2, v3);
 }
 void Shader::setVec3(const std::string& name, const glm::vec3& vec3) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), vec3.x, vec3.y, vec3.z);
+    glUniform3f(Location(name), vec3.x, vec3.y, vec3.z);
 }
 
 void Shader::setiVec3(const std::string& name, int v1, int v2, int v3) const
 {
-    glUniform3i(glGetUniformLocation(ID, name.c_str()), v1, v2, v3);
+    glUniform3i(Location(name), v1, v2, v3);
 }
 void Shader::setiVec3(const std::string& name, const glm::ivec3& vec3) const
 {
-    glUniform3i(glGetUniformLocation(ID, name.c_str()), vec3.x, vec3.y, vec3.z);
+    glUniform3i(Location(name), vec3.x, vec3.y, vec3.z);
 }
 
 void Shader::setVec2(const std::string& name, float v1, float v2) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), v1, v2);
+    glUniform2f(Location(name), v1, v2);
 }
 void Shader::setVec2(const std::string& name, const glm::vec2& vec2) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), vec2.x, vec2.y);
+    glUniform2f(Location(name), vec2.x, vec2.y);
 }
 
 void Shader::setMat4(const std::string& name, const float* transform) const
 {       
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()),1,GL_FALSE,transform);
+    glUniformMatrix4fv(Location(name),1,GL_FALSE,transform);
+}
+
+void Shader::setIntArray(const std::string& name, const int* values, int count) const
+{
+    glUniform1iv(Location(name), count, values);
+}
+void Shader::setVec2Array(const std::string& name, const glm::vec2* values, int count) const
+{
+    glUniform2fv(Location(name), count, glm::value_ptr(values[0]));
+}
+void Shader::setVec3Array(const std::string& name, const glm::vec3* values, int count) const
+{
+    glUniform3fv(Location(name), count, glm::value_ptr(values[0]));
+}
+void Shader::setMat4Array(const std::string& name, const glm::mat4* values, int count) const
+{
+    glUniformMatrix4fv(Location(name), count, GL_FALSE, glm::value_ptr(values[0]));
+}
+
+Shader::Uniform Shader::GetUniform(const std::string& name) const
+{
+    return Uniform{ Location(name) };
+}
+void Shader::setBool(Uniform uniform, bool value) const
+{
+    glUniform1i(uniform.location, (int)value);
+}
+void Shader::setInt(Uniform uniform, int value) const
+{
+    glUniform1i(uniform.location, value);
+}
+void Shader::setFloat(Uniform uniform, float value) const
+{
+    glUniform1f(uniform.location, value);
+}
+void Shader::setVec3(Uniform uniform, const glm::vec3& vec3) const
+{
+    glUniform3f(uniform.location, vec3.x, vec3.y, vec3.z);
+}
+void Shader::setMat4(Uniform uniform, const float* transform) const
+{
+    glUniformMatrix4fv(uniform.location, 1, GL_FALSE, transform);
+}
+
+void Shader::Reflect()
+{
+    GLint count = 0, maxLength = 0;
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxLength);
+    std::vector<char> buffer(maxLength + 1);
+    const GLenum props[2] = { GL_LOCATION, GL_ARRAY_SIZE };
+    for (GLint i = 0; i != count; i++)
+    {
+        GLint values[2];
+        glGetProgramResourceiv(ID, GL_UNIFORM, i, 2, props, 2, NULL, values);
+        //members of uniform blocks have no location
+        if (values[0] < 0)
+            continue;
+        glGetProgramResourceName(ID, GL_UNIFORM, i, (GLsizei)buffer.size(), NULL, buffer.data());
+        std::string name(buffer.data());
+        uniforms[name] = values[0];
+
+        //an array is one resource named "x[0]", its other elements are looked up once here instead of on every set
+        if (name.size() < 3 || name.compare(name.size() - 3, 3, "[0]") != 0)
+            continue;
+        std::string base = name.substr(0, name.size() - 3);
+        uniforms[base] = values[0];
+        for (GLint j = 1; j < values[1]; j++)
+        {
+            std::string element = base + "[" + std::to_string(j) + "]";
+            uniforms[element] = glGetUniformLocation(ID, element.c_str());
+        }
+    }
+}
+
+int Shader::Location(const std::string& name) const
+{
+    //inactive or misspelt uniforms get -1, which glUniform* ignores
+    std::unordered_map<std::string, int>::const_iterator it = uniforms.find(name);
+    return it == uniforms.end() ? -1 : it->second;
 }
 #endif
@@ -207,10 +207,7 @@ void DotShadow::DrawShadowMap(vector<Object> objects)
 	shadowmapShader.setFloat("far_plane", far);
 	shadowmapShader.setVec3("lightPos", light.Position);
 
-	for (unsigned int i = 0; i != 6; i++)
-	{
-		shadowmapShader.setMat4(("shadowMatrixs[" + std::to_string(i) + "]").c_str(), glm::value_ptr(shadowTransforms[i]));
-	}
+	shadowmapShader.setMat4Array("shadowMatrixs", shadowTransforms.data(), 6);
 
 	for (unsigned int i = 0; i != objects.size(); i++)
 	{
@@ -341,10 +338,7 @@ void SpotShadow::DrawShadowMap(vector<Object> objects)
 	shadowmapShader.setFloat("far_plane", far);
 	shadowmapShader.setVec3("lightPos", light.Position);
 
-	for (unsigned int i = 0; i != 6; i++)
-	{
-		shadowmapShader.setMat4(("shadowMatrixs[" + std::to_string(i) + "]").c_str(), glm::value_ptr(shadowTransforms[i]));
-	}
+	shadowmapShader.setMat4Array("shadowMatrixs", shadowTransforms.data(), 6);
 
 	for (unsigned int i = 0; i != objects.size(); i++)
 	{